@@ -16,7 +16,8 @@
 // Construct/destruct etc
 ImageAnalyst::ImageAnalyst(const bfs::path f, const AnalystSettings& s): 
     Image::Image(f.c_str()), fileLocation(f), notSegmented(true), 
-    settings(s), logger(new Logger(localLoggingLevel)) 
+    settings(s), labeler(s.connectivity), 
+    logger(new Logger(localLoggingLevel)) 
 {
 	// Set window arguments  
     iMin = s.segmentWindow(0);
@@ -44,168 +45,372 @@ ImageAnalyst::~ImageAnalyst() {
        This should improve the convergence of the segmentation 
        algorithm by reducing the noise and making the differences 
        between image segments larger.  
-    2. Segmentation sweep:
-   	    1. Loop until a black pixel is found. 
-   		2. If a black pixel is found then check its neighbours (whose indices 
-   		   are less than the current index) for labels.
-   			-- If one neighbour has a label, or more than one 
-   			   neighbour has a label but these are the same, 
-   			   assign the current pixel to that label by appending 
-   			   its indices to the label vector and updating the label
-   			   in the label image.
-   			-- If more than one neighbour has a label 
-   			   and they are different, add the two labels to the equivalent
-   			   labels list, append the current pixel to the lowest label.
-   			-- If no neighbours have labels then start a new label number 
-   			   and append the current pixel location to it.              
-           Then if there is more than one unique label value amongst a pixel's 
-           labels, we insert and merge the labels with the equivalent labels 
-           list. This is done by insert_and_merge so that the equivalent 
-           labels list maintains a completely disjunctive set of sets.
-   		   Step 2 is carried out by the ImageAnalyst::_update_labels method
-   		3. Return to loop until next black pixel is found
+    2. Threshold the segmentation window and pack it into a BinaryMask, 
+       with one bit per pixel. Depending on the settings the threshold is 
+       global or adapts to the local mean (or Sauvola's combination of the 
+       local mean and standard deviation) over a window of 
+       thresholdWindow*blobSize pixels around each pixel. Thresholding is 
+       done as the greyscale values are read out of the pixel cache, by 
+       ImageAnalyst::_fill_mask.
+    3. Label the connected foreground runs in the mask with a RunLabeler, 
+       using the connectivity given in the settings. 
+       Since the labeler skips empty words and works on whole runs rather 
+       than pixels, sparse frames cost time proportional to the number of 
+       foreground runs rather than the number of pixels.
+    4. Group the labelled runs by label so that blob data can be recovered 
+       by the accessor methods.
+    If pyramidLevels is set, steps 1-3 are first run on a downsampled copy 
+    of the image to find candidate blobs, and then only on regions around 
+    the candidates at full resolution (see ImageAnalyst::_segment_pyramid).
 */
 void ImageAnalyst::segment() {
-    // Prepare image (using Magick++::Image methods)  
-    blur(settings.blobSize);   
-    quantizeDither(false); 
-    quantizeColorSpace(Magick::GRAYColorspace); 
-    quantize(); 
-    threshold(settings.thresholdFraction*MaxRGB);       
-    negate(); // Sets background = 0 
-	
-	// Generate labels image       
-    logger->message("Making initial pass of image", debugLevel);
-	labelArray.resize(columns(), rows()); 
-    labelArray = background; 
-    for(int i = iMin; i < iMax; ++i)
-        for(int j = jMin; j < jMax; ++j)
-            if (int(pixelColor(i, j).redQuantum()) != background)
-                _update_labels(i, j);
-    
-    // Mark all equivalent labels in label array with the same number, these 
-    // have already been stored in the labelLocationArray so just loop over 
-    // that. Can use the stored indices for indirection in blitz array so 
-    // can just pass the entire vector to the array. Note that blitz requires
-    // another array for efficient indirection.      
-    logger->message("Merging equivalent labels", debugLevel);
-    Label currentLabelValue = 1;
-    std::vector< std::vector<Index> > mergedLocations;             
-    foreach(std::set<Label> labelSet, equivalentLabels) {
-        // Merge all indices with equivalent labels into one index vector
-        std::vector<Index> currentMergedIndices;
-        foreach(Label label, labelSet)
-            foreach(Index index, labelLocations[label-1])
-                currentMergedIndices.push_back(index); 
-        mergedLocations.push_back(currentMergedIndices);
-                
-        // Update values of specified pixels  
-        blitz::Array<Label, 2> floodArray(columns(), rows());
-        floodArray = currentLabelValue;
-        labelArray[currentMergedIndices] = floodArray;
-        
-        // Get next label
-        currentLabelValue++; 
-    } 
-    
-    // Update new maximum label and location vectors  
-    labelLocations = mergedLocations;
-    maxLabel = currentLabelValue;   
+    labelRuns.clear();
+    if (settings.pyramidLevels > 0) _segment_pyramid();
+    else _segment_full();
+    maxLabel = labelRuns.size();
     
     // Update segmentation flag to say that image has been segmented
     notSegmented = false;
     
     // If required, save segmented picture to file
-    if (settings.saveChangedFile) {   
-        // Replace array with current labelArray, with labels normalised 
-        // by value to MaxRGB
-        for(int i = iMin; i < iMax; ++i)
-            for(int j = jMin; j < jMax; ++j) {
-                int val = round(labelArray(i, j)*MaxRGB/maxLabel);
-                pixelColor(i, j, Magick::Color(val, val, val));
-            }    
-        
-        // Return colors to normal
-        negate();                 
-        
-        // Add red dots for segment locations 
-        std::vector<Index> centroids;
-        get_centroids(centroids);     
-        strokeColor("red");
-        fillColor("none");
-        strokeWidth(1);
-        foreach(Index index, centroids)
-            draw(Magick::DrawableCircle(
-                index[0]-1, index[1]-1, index[0]+1, index[1]+1));  
-                
-        // Add red line for segment extraction boundary         
-        draw(Magick::DrawableRectangle(iMin, jMin, iMax, jMax));
-        
-        // Check for segments folder, add if it doesn't exist 
-        bfs::path segmentFolder = "segments";
-        if (not(bfs::is_directory(segmentFolder)))
-            bfs::create_directory(segmentFolder);
-        
-        // Write changed image to new file
-        std::ostringstream segmentFile;
-        segmentFile << segmentFolder.c_str() << "/"
-                    << fileLocation.stem().c_str() 
-                    << "_segments" << bfs::extension(fileLocation); 
-        write(segmentFile.str().c_str());
-    }   
+    if (settings.saveChangedFile) _save_segments();
+}
+void ImageAnalyst::_segment_full() {
+    _prepare(*this, settings.blobSize);
+	
+	// Threshold image into mask and label it
+    logger->message("Thresholding image into mask", debugLevel);
+    const Box window(iMin, iMax, jMin, jMax);
+    _fill_mask(*this, window, settings.thresholdWindow*settings.blobSize);
+    logger->message("Labelling foreground runs", debugLevel);
+    labeler.label(mask);
+    _add_blobs(window, labelRuns);
+}
+
+/* blob_centroid
+   Mean pixel position of a blob. Each run contributes an arithmetic series 
+   of column indices, so we don't need to visit individual pixels.
+*/
+static blitz::TinyVector<double, 2> blob_centroid(const std::vector<Run>& blob) 
+{
+    double sumI = 0, sumJ = 0, area = 0;
+    foreach(const Run& run, blob) {
+        const double length = run.end - run.begin;
+        sumI += 0.5*(run.begin + run.end - 1)*length;
+        sumJ += run.row*length;
+        area += length;
+    }
+    return blitz::TinyVector<double, 2>(sumI/area, sumJ/area);
+}
+
+/* centroids_within
+   Whether every blob in previous has a blob in current with a centroid 
+   within tolerance of its own. New blobs in current don't matter, since 
+   they are checked for clipping separately.
+*/
+static bool centroids_within(const std::vector< std::vector<Run> >& previous,
+    const std::vector< std::vector<Run> >& current, double tolerance)
+{
+    std::vector< blitz::TinyVector<double, 2> > centroids;
+    foreach(const std::vector<Run>& blob, current)
+        centroids.push_back(blob_centroid(blob));
+    foreach(const std::vector<Run>& blob, previous) {
+        const blitz::TinyVector<double, 2> centroid = blob_centroid(blob);
+        bool found = false;
+        for (std::size_t c = 0; c < centroids.size() && !found; ++c) {
+            const double di = centroids[c][0] - centroid[0], 
+                         dj = centroids[c][1] - centroid[1];
+            found = (di*di + dj*dj <= tolerance*tolerance);
+        }
+        if (!found) return false;
+    }
+    return true;
+}
+
+/* merge_regions
+   Replaces any overlapping regions in the list with their union, repeating 
+   until no regions overlap. A merged region has to be refined again, and 
+   keeps the blobs of both regions to compare against. There are only 
+   ever a handful of candidate regions so the quadratic search doesn't 
+   matter.
+*/
+static void merge_regions(std::vector<PyramidRegion>& regions) {
+    bool madeChanges = true;
+    while (madeChanges) {
+        madeChanges = false;
+        for (std::size_t a = 0; a < regions.size() && !madeChanges; ++a)
+            for (std::size_t b = a + 1; b < regions.size(); ++b) {
+                Box& A = regions[a].box;
+                const Box& B = regions[b].box;
+                if (A[0] < B[1] && B[0] < A[1] && A[2] < B[3] && B[2] < A[3]) {
+                    A = Box(std::min(A[0], B[0]), std::max(A[1], B[1]), 
+                            std::min(A[2], B[2]), std::max(A[3], B[3]));
+                    regions[a].blobs.insert(regions[a].blobs.end(), 
+                        regions[b].blobs.begin(), regions[b].blobs.end());
+                    regions[a].refined = false;
+                    regions[a].nRefinements = std::min(
+                        regions[a].nRefinements, regions[b].nRefinements);
+                    regions.erase(regions.begin() + b);
+                    madeChanges = true;
+                    break;
+                }
+            }
+    }
 }
-void ImageAnalyst::_update_labels(int i, int j) {
-    // Get the _non-zero_ label values of the west, northwest, northern and 
-    // northeastern  pixels, and stash them in neighbourValues. 
-    blitz::TinyVector<Label, 4> neighbours(0);
-    if (i != 0 && j != 0)     neighbours[0] = labelArray(i-1, j-1);
-    if (i != 0)               neighbours[1] = labelArray(i-1, j);
-    if (j != 0)               neighbours[2] = labelArray(i, j-1);
-    if (i != columns()-1 && j != 0) neighbours[3] = labelArray(i+1, j-1);
-    neighbourValues.clear();  
-    foreach(Label label, neighbours)
-        if (label > 0) 
-            neighbourValues.insert(label);      
+
+/*  Coarse-to-fine segmentation for sparse frames. This proceeds as follows:
+    1. Scale a copy of the image down by 2^pyramidLevels and segment it 
+       with the blob size and threshold window scaled to match.
+    2. Take the bounding box of each coarse blob at full resolution and 
+       dilate it by a margin covering the coarse pixel size and the blur 
+       and local threshold windows. Overlapping boxes are merged.
+    3. Crop each box out of the full resolution image and segment it as 
+       usual. The box is grown by the margin and refined again if
+        -- a blob touches an edge of the box which isn't also an edge of 
+           the segmentation window, so it may have been clipped, or
+        -- a blob found at the last refinement has no blob within 
+           pyramidTolerance pixels of its centroid this time. The first 
+           refinement has nothing to compare with, so every box is 
+           refined at least twice.
+       Only grown boxes, and any they now overlap, are refined again. 
+       After maxRefineAttempts growths the blobs are kept as they are and 
+       a warning is logged.
+    Blobs whose centroids stop moving as their box grows have settled on 
+    their full resolution centroids to within pyramidTolerance. Blobs 
+    which vanish when downsampled are missed, so pyramidLevels should be 
+    small enough that blobs are still a few pixels across in the coarse 
+    image.
+*/
+void ImageAnalyst::_segment_pyramid() {
+    const int factor = 1 << settings.pyramidLevels;
+    const int thresholdRadius = \
+        (settings.thresholdMode == globalThreshold) ? 0 
+        : settings.thresholdWindow*settings.blobSize;
+    const int margin = factor + 2*settings.blobSize + thresholdRadius;
+    
+    // Segment a downsampled copy of the image
+    logger->message("Finding candidate blobs in downsampled image", 
+        debugLevel);
+    Magick::Image coarse(*this);
+    Magick::Geometry coarseSize(std::max(columns()/factor, 1u), 
+                                std::max(rows()/factor, 1u));
+    coarseSize.aspect(true);
+    coarse.scale(coarseSize);
+    const double iScale = double(columns())/coarse.columns(), 
+                 jScale = double(rows())/coarse.rows();
+    const Box coarseWindow(
+        int(iMin/iScale), 
+        std::min(int(ceil(iMax/iScale)), int(coarse.columns())),
+        int(jMin/jScale), 
+        std::min(int(ceil(jMax/jScale)), int(coarse.rows())));
+    _prepare(coarse, std::max(settings.blobSize/double(factor), 1.0));
+    _fill_mask(coarse, coarseWindow, thresholdRadius/factor);
+    labeler.label(mask);
+    
+    // Get dilated full resolution bounding boxes of the candidates 
+    PyramidRegion empty;
+    empty.box = Box(std::numeric_limits<int>::max(), 
+        std::numeric_limits<int>::min(), std::numeric_limits<int>::max(), 
+        std::numeric_limits<int>::min());
+    empty.refined = false;
+    empty.nRefinements = 0;
+    std::vector<PyramidRegion> regions(labeler.get_maximum_label(), empty);
+    foreach(const Run& run, labeler.get_runs()) {
+        Box& box = regions[run.label-1].box;
+        box[0] = std::min(box[0], coarseWindow[0] + run.begin);
+        box[1] = std::max(box[1], coarseWindow[0] + run.end);
+        box[2] = std::min(box[2], coarseWindow[2] + run.row);
+        box[3] = std::max(box[3], coarseWindow[2] + run.row + 1);
+    }
+    foreach(PyramidRegion& region, regions) {
+        const Box& box = region.box;
+        region.box = Box(std::max(int(box[0]*iScale) - margin, iMin),
+                         std::min(int(ceil(box[1]*iScale)) + margin, iMax),
+                         std::max(int(box[2]*jScale) - margin, jMin),
+                         std::min(int(ceil(box[3]*jScale)) + margin, jMax));
+    }
+    
+    // Refine candidate regions at full resolution
+    std::ostringstream msg;
+    msg << "Refining " << regions.size() << " candidate blobs";
+    logger->message(msg.str(), debugLevel);
+    bool grown = true;
+    for (int attempt = 0; grown; ++attempt) {
+        merge_regions(regions);
+        grown = false;
+        foreach(PyramidRegion& region, regions) {
+            if (region.refined) continue;
+            const std::vector< std::vector<Run> > previous = region.blobs;
+            const bool comparable = (region.nRefinements > 0);
+            _refine_region(region);
+            
+            // Grow regions whose blobs may have been clipped or haven't 
+            // settled yet. A region covering the whole window gives the 
+            // full resolution blobs already.
+            const Box& box = region.box;
+            const bool wholeWindow = (box[0] == iMin && box[1] == iMax 
+                                      && box[2] == jMin && box[3] == jMax);
+            if (wholeWindow || (not(_touches_interior_edge(box)) 
+                && comparable && centroids_within(previous, region.blobs, 
+                    settings.pyramidTolerance)))
+                continue;
+            if (attempt >= maxRefineAttempts) {
+                std::ostringstream msg;
+                msg << "Blobs in pyramid region (" << box[0] << ", " 
+                    << box[1] << ", " << box[2] << ", " << box[3] 
+                    << ") didn't settle after " << maxRefineAttempts 
+                    << " attempts";
+                logger->message(msg.str(), warningLevel);
+            } else {
+                region.box = Box(std::max(box[0] - margin, iMin),
+                                 std::min(box[1] + margin, iMax),
+                                 std::max(box[2] - margin, jMin),
+                                 std::min(box[3] + margin, jMax));
+                region.refined = false;
+                grown = true;
+            }
+        }
+    }
     
-    // Check the neighbours' values, perform relevant updates  
-    Index index(i, j);
-    if (neighbourValues.size() > 0) {
-        // Label a point in the label array with the maximum label of it's 
-        // neighbours, and add the current label location to the list of label 
-        // locations in the labelLocationList attribute
-        Label currentLabel = \
-            *(std::max_element(
-                neighbourValues.begin(), 
-                neighbourValues.end()));
-        labelArray(index) = currentLabel;   
-        labelLocations[currentLabel-1].push_back(index);  
-           
-        // Record that multiple neighbour labels are equivalent, if there's 
-        // more than one value in the array.
-        if (neighbourValues.size() > 1) 
-            insert_and_merge(neighbourValues, equivalentLabels);
-    } else {
-        // There are no labelled neighbours, so make a new label for the 
-        // current index which is higher than all previous labels 
-        std::vector<Index> newLabelVec(1, index);
-        labelLocations.push_back(newLabelVec); 
-        labelArray(index) = labelLocations.size();  
+    // Gather the blobs from all regions, numbering them in turn
+    foreach(const PyramidRegion& region, regions)
+        foreach(const std::vector<Run>& blob, region.blobs) {
+            labelRuns.push_back(blob);
+            foreach(Run& run, labelRuns.back()) 
+                run.label = Label(labelRuns.size());
+        }
+}
+
+// Crop the region out of the image and find the blobs in it
+void ImageAnalyst::_refine_region(PyramidRegion& region) {
+    const Box& box = region.box;
+    Magick::Image image(*this);
+    image.crop(Magick::Geometry(box[1] - box[0], box[3] - box[2], 
+                                box[0], box[2]));
+    _prepare(image, settings.blobSize);
+    const Box imageWindow(0, box[1] - box[0], 0, box[3] - box[2]);
+    _fill_mask(image, imageWindow, 
+        settings.thresholdWindow*settings.blobSize);
+    labeler.label(mask);
+    region.blobs.clear();
+    _add_blobs(box, region.blobs);
+    region.refined = true;
+    ++region.nRefinements;
+}
+
+// Prepare image for thresholding (using Magick++::Image methods)  
+void ImageAnalyst::_prepare(Magick::Image& image, double blurRadius) {
+    image.blur(blurRadius);   
+    image.quantizeDither(false); 
+    image.quantizeColorSpace(Magick::GRAYColorspace); 
+    image.quantize(); 
+}
+void ImageAnalyst::_fill_mask(const Magick::Image& image, const Box& box, 
+    int windowRadius) 
+{
+    // Read the greyscale box a row at a time from the pixel cache and 
+    // pass it through the thresholder, which sets a bit for every 
+    // foreground (dark) pixel. Local thresholds lag the input by the 
+    // window radius, so the last rows come out when we flush.
+    const int width = box[1] - box[0], height = box[3] - box[2];
+    mask.resize(width, height);
+    RowThresholder thresholder(width, height, settings.thresholdMode, 
+        windowRadius, settings.thresholdFraction, settings.sauvolaK, MaxRGB);
+    std::vector<float> gray(width);
+    int nextRow = 0;
+    for(int j = 0; j < height; ++j) {
+        const Magick::PixelPacket* pixels = \
+            image.getConstPixels(box[0], box[2] + j, width, 1);
+        for(int i = 0; i < width; ++i)
+            gray[i] = pixels[i].red;
+        if (thresholder.push_row(&gray[0], mask.row(nextRow)) >= 0) 
+            ++nextRow;
+    }
+    while (nextRow < height && thresholder.flush_row(mask.row(nextRow)) >= 0)
+        ++nextRow;
+}
+
+// Add the labeler's blobs to a list of blobs, for a mask covering the 
+// given box
+void ImageAnalyst::_add_blobs(const Box& box, 
+    std::vector< std::vector<Run> >& blobs) 
+{
+    const std::size_t firstBlob = blobs.size();
+    blobs.resize(firstBlob + labeler.get_maximum_label());
+    foreach(Run run, labeler.get_runs()) {
+        run.begin += box[0] - iMin;
+        run.end += box[0] - iMin;
+        run.row += box[2] - jMin;
+        run.label += Label(firstBlob);
+        blobs[run.label-1].push_back(run);
     }
-} 
+}
+
+// Whether the labeler's blobs touch an edge of the box inside the window
+bool ImageAnalyst::_touches_interior_edge(const Box& box) {
+    const int width = box[1] - box[0], height = box[3] - box[2];
+    foreach(const Run& run, labeler.get_runs())
+        if ((run.begin == 0 && box[0] > iMin) 
+            || (run.end == width && box[1] < iMax)
+            || (run.row == 0 && box[2] > jMin) 
+            || (run.row == height - 1 && box[3] < jMax))
+            return true;
+    return false;
+}
+void ImageAnalyst::_save_segments() {
+    // Paint labels into the label array from the labelled runs
+    labelArray.resize(columns(), rows()); 
+    labelArray = background;
+    foreach(const std::vector<Run>& blob, labelRuns)
+        foreach(const Run& run, blob)
+            labelArray(blitz::Range(iMin + run.begin, iMin + run.end - 1), 
+                       jMin + run.row) = run.label;
+    
+    // Replace window with current labelArray, with labels normalised 
+    // by value to MaxRGB and inverted so the background is white. The 
+    // image outside the window is left as it is.
+    const Label normalisation = std::max(maxLabel, Label(1));
+    for(int i = iMin; i < iMax; ++i)
+        for(int j = jMin; j < jMax; ++j) {
+            int val = MaxRGB - round(labelArray(i, j)*MaxRGB/normalisation);
+            pixelColor(i, j, Magick::Color(val, val, val));
+        }    
+    
+    // Add red dots for segment locations 
+    std::vector<Index> centroids;
+    get_centroids(centroids);     
+    strokeColor("red");
+    fillColor("none");
+    strokeWidth(1);
+    foreach(Index index, centroids)
+        draw(Magick::DrawableCircle(
+            index[0]-1, index[1]-1, index[0]+1, index[1]+1));  
+            
+    // Add red line for segment extraction boundary         
+    draw(Magick::DrawableRectangle(iMin, jMin, iMax, jMax));
+    
+    // Check for segments folder, add if it doesn't exist 
+    bfs::path segmentFolder = "segments";
+    if (not(bfs::is_directory(segmentFolder)))
+        bfs::create_directory(segmentFolder);
+    
+    // Write changed image to new file
+    std::ostringstream segmentFile;
+    segmentFile << segmentFolder.c_str() << "/"
+                << fileLocation.stem().c_str() 
+                << "_segments" << bfs::extension(fileLocation); 
+    write(segmentFile.str().c_str());
+}
 
 // = Accessor methods for blob data =
 void ImageAnalyst::get_centroids(std::vector<Index>& centroids) {
     // Check that image has already been segmented
     if (notSegmented) throw ImageNotSegmented();
     
-    // Otherwise, return the location of the blob centroids by summing the 
-    // indices of pixels in the blob and returning their mean. 
-    foreach(std::vector<Index> blob, labelLocations) {  
-        Index currentCentroid(0, 0);
-        foreach(Index index, blob)
-            currentCentroid += index; // Store sums in centroid
-        currentCentroid[0] = int(currentCentroid[0]/double(blob.size()));
-        currentCentroid[1] = int(currentCentroid[1]/double(blob.size()));
+    // Otherwise, return the location of the blob centroids
+    foreach(const std::vector<Run>& blob, labelRuns) {  
+        const blitz::TinyVector<double, 2> centroid = blob_centroid(blob);
+        Index currentCentroid(iMin + int(centroid[0]), jMin + int(centroid[1]));
         centroids.push_back(currentCentroid);
     }
 }
@@ -215,7 +420,10 @@ Label ImageAnalyst::get_maximum_label() {
 }  
 void ImageAnalyst::get_blob(Label label, std::vector<Index>& blob) {
     if (notSegmented) throw ImageNotSegmented();
-    if (label > maxLabel || label < background) 
+    if (label > maxLabel || label <= background) 
         throw InvalidLabel(label, maxLabel, background);
-    blob = labelLocations[label-1];
-} 
\ No newline at end of file
+    blob.clear();
+    foreach(const Run& run, labelRuns[label-1])
+        for(int i = run.begin; i < run.end; ++i)
+            blob.push_back(Index(iMin + i, jMin + run.row));
+}
@@ -10,15 +10,33 @@
 #include "types.hpp"   
 #include "utilities.hpp"                        
 #include "logger.hpp"   
+#include "mask.hpp"
+#include "labeler.hpp"
+#include "threshold.hpp"
 
 // = Settings struct =
 typedef struct {                     
     blitz::TinyVector<int, 4> segmentWindow;
+    ThresholdMode thresholdMode;
     double thresholdFraction;
+    int thresholdWindow; // local threshold radius, in multiples of blobSize
+    double sauvolaK;
     int blobSize;
+    int connectivity; // 4 or 8 neighbour connectivity for blobs
+    int pyramidLevels; // detect on image downsampled by 2^levels, 0 = off
+    double pyramidTolerance; // centroid shift (pixels) accepted in pyramid
     bool saveChangedFile;
+    bool streaming; // segment in row strips without loading whole image
 } AnalystSettings;
 
+// A candidate region refined at full resolution in pyramid mode
+typedef struct {
+    Box box;
+    std::vector< std::vector<Run> > blobs; // runs in window coordinates
+    bool refined; // whether blobs have been found for the current box
+    int nRefinements; // number of times blobs have been found
+} PyramidRegion;
+
 // = Class interface =
 class ImageAnalyst: public Magick::Image {
 public:                              
@@ -48,19 +66,27 @@ private:
 	AnalystSettings settings;   
     
 	// Segmentation data    
-    blitz::Array<Label, 2> labelArray;                         
-    std::list< std::set<Label> > equivalentLabels; 
-    Index currentIndex;
-    std::set<Label> neighbourValues;
+    BinaryMask mask;       // thresholded window, one bit per pixel
+    RunLabeler labeler;
+    blitz::Array<Label, 2> labelArray; // only filled when saving segments
     
     // Useful data once image has been segmented 
     static const Label background = 0;
     Label maxLabel;
     bool notSegmented; 
-    std::vector< std::vector<Index> > labelLocations;
+    std::vector< std::vector<Run> > labelRuns; // runs in window coordinates
+    static const int maxRefineAttempts = 3; // pyramid region growth limit
     
     // Segmentation functions  
-    void _update_labels(int i, int j);
+    void _segment_full();
+    void _segment_pyramid();
+    void _prepare(Magick::Image& image, double blurRadius);
+    void _fill_mask(const Magick::Image& image, const Box& box, 
+        int windowRadius);
+    void _refine_region(PyramidRegion& region);
+    void _add_blobs(const Box& box, std::vector< std::vector<Run> >& blobs);
+    bool _touches_interior_edge(const Box& box);
+    void _save_segments();
 	
 	// Logging
 	const static LogLevel localLoggingLevel = traceLevel;   
@@ -17,6 +17,7 @@
 #include <set> 
 #include <list>            
 #include <algorithm> 
+#include <limits>
 #include <math.h>
 #include <GraphicsMagick/Magick++.h>
 #include <blitz/array.h>      
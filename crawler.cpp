@@ -7,18 +7,132 @@
 
 #include "crawler.hpp" 
 
+/* stable_hash
+   64-bit FNV-1a hash of a string. Unlike boost::hash this doesn't depend 
+   on the platform or library version, so every machine in a sharded run 
+   assigns a file to the same shard.
+*/
+static boost::uint64_t stable_hash(const std::string& value) {
+    boost::uint64_t hash = 14695981039346656037ULL;
+    foreach(unsigned char c, value) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
 // Ctor, dtor etc
 Crawler::Crawler(const CrawlerSettings& s, const AnalystSettings& as):  
-    settings(s), analyst_settings(as), logger(new Logger(localLoggingLevel))
+    settings(s), analyst_settings(as), nextSequence(0), nSearchPaths(0), 
+    logger(new Logger(localLoggingLevel))
 {
+    if (settings.shardCount < 1 || settings.shardIndex < 0 
+        || settings.shardIndex >= settings.shardCount)
+        throw InvalidShardSpec(settings.shardIndex, settings.shardCount);
+    
+    // Each shard writes to its own output file, e.g. dump_shard0of4.py
+    if (settings.shardCount > 1) {
+        std::ostringstream shardFile;
+        shardFile << settings.outputfile.stem().string() << "_shard" 
+                  << settings.shardIndex << "of" << settings.shardCount
+                  << bfs::extension(settings.outputfile);
+        settings.outputfile = \
+            settings.outputfile.parent_path() / shardFile.str();
+    }
     logger->message("Constructed crawler instance", debugLevel);
 }
 Crawler::~Crawler() {
     logger->message("Destructing crawler instance", debugLevel);
 } 
 
-// Operator for given path
+// Operator for given path - collects matching files under the path
 void Crawler::operator()(const bfs::path& path) {
+    _traverse(path, path);
+    ++nSearchPaths;
+}
+
+/*  Processes the matched files. Files are sorted by the search path they 
+    were found under, in command line order, and then by their key (the 
+    path relative to that search path), and numbered in that order. Each 
+    search path is therefore processed in turn, as separate runs should 
+    be, and every process in a sharded run agrees on the sequence number 
+    of every file whichever shard it handles. Full paths break any 
+    remaining ties, so the order never depends on the order in which the 
+    filesystem lists directories. The sequence number is written with 
+    each record so that shard outputs can be merged back into frame order 
+    by merge_shards.py.
+    
+    If skipFailures is set, files which can't be analysed (e.g. because 
+    they are still being written) are logged and skipped rather than 
+    stopping the crawl, and can be picked up again by add_file.
+*/
+static bool crawl_order_less(const MatchedFile& a, const MatchedFile& b) {
+    if (a.searchPath != b.searchPath) return a.searchPath < b.searchPath;
+    if (a.key != b.key) return a.key < b.key;
+    return a.path.string() < b.path.string();
+}
+void Crawler::process(bool skipFailures) {
+    std::stable_sort(matchedFiles.begin(), matchedFiles.end(), 
+        crawl_order_less);
+    
+    std::ostringstream msg;
+    msg << "Matched " << matchedFiles.size() << " files, processing shard " 
+        << settings.shardIndex << " of " << settings.shardCount;
+    logger->message(msg.str(), traceLevel);
+    
+    for (std::size_t sequence = 0; sequence < matchedFiles.size(); ++sequence) {
+        const MatchedFile& file = matchedFiles[sequence];
+        if (not(_in_shard(file, sequence))) continue;
+        try {
+            analyse_image(file.path, nextSequence + sequence);
+            seenFiles.insert(file.path.string());
+        } catch(std::exception& e) {
+            if (not(skipFailures)) throw;
+            _failure_message(file.path, e);
+        }
+    }
+    nextSequence += matchedFiles.size();
+    matchedFiles.clear();
+    matchedPaths.clear();
+}
+
+/*  Processes a single new file straight away, e.g. one which has just 
+    been written to a watched directory. New files are numbered in the 
+    order they arrive, following on from any processed files, and files 
+    which have already been analysed are skipped. A file only counts as 
+    analysed once analyse_image succeeds, so if it throws (e.g. because 
+    the file was still being written) the file is picked up again by the 
+    next call. 
+    
+    Arrival order differs from one process to the next, so new files 
+    can't be numbered consistently across shards. Watching is therefore 
+    only supported without sharding (main rejects --watch with --shard).
+*/
+void Crawler::add_file(const bfs::path& path) {
+    if (not(_match_regex(path.filename()))) {
+        _ignore_message(path);
+        return;
+    }
+    if (seenFiles.count(path.string()) > 0) return;
+    
+    analyse_image(path, nextSequence);
+    ++nextSequence;
+    seenFiles.insert(path.string());
+}
+bool Crawler::_in_shard(const MatchedFile& file, std::size_t sequence) {
+    const std::size_t count = settings.shardCount, 
+                      index = settings.shardIndex;
+    if (settings.shardMode == hashShards)
+        return stable_hash(file.key) % count == index;
+    
+    // Otherwise shard i takes files [i*n/N, (i+1)*n/N) of the sorted list
+    const std::size_t nFiles = matchedFiles.size();
+    return (sequence >= index*nFiles/count) 
+        && (sequence < (index + 1)*nFiles/count);
+}
+
+// Traverse path, storing regex-matched files
+void Crawler::_traverse(const bfs::path& path, const bfs::path& root) {
     // Check argument type: only directories or regex-matched files allowed
     if (bfs::is_directory(path)) {
         std::ostringstream msg;
@@ -33,52 +147,93 @@ void Crawler::operator()(const bfs::path& path) {
                 _ignore_message(it->path());
                 continue;
             }
-            (*this)(it->path());
+            _traverse(it->path(), root);
         }    
-    } else if (_match_regex(path.filename())) 
-        analyse_image(path);
-    else _ignore_message(path); 
+    } else if (_match_regex(path.filename())) {
+        if (seenFiles.count(path.string()) == 0 
+            && matchedPaths.insert(path.string()).second)
+            matchedFiles.push_back(_make_file(path, root));
+    } else _ignore_message(path); 
 }  
+MatchedFile Crawler::_make_file(const bfs::path& path, const bfs::path& root) {
+    // Key is the path relative to the search path, or just the file 
+    // name if a file was given directly
+    MatchedFile file;
+    file.path = path;
+    file.searchPath = nSearchPaths;
+    if (path == root) 
+        file.key = path.filename().string();
+    else {
+        file.key = path.string().substr(root.string().size());
+        file.key.erase(0, file.key.find_first_not_of('/'));
+    }
+    return file;
+}
 
 // Analysis routine
-void Crawler::analyse_image(const bfs::path& path) 
+void Crawler::analyse_image(const bfs::path& path, std::size_t sequence) 
 {
     std::ostringstream msg;
     msg << "Running image analysis on " << path;
 	logger->message(msg.str(), traceLevel);
 
-    // Construct and segment picture
-    std::auto_ptr<ImageAnalyst> \
-        analyst(new ImageAnalyst(bfs::absolute(path.filename()), 
-            analyst_settings));
-	analyst->segment();
+    // Construct and segment picture, either whole or in row strips
+    unsigned int columns, rows;
+    blitz::TinyVector<int, 4> wsize;
+    std::vector<Index> centroids;
+    bool streamed = false;
+    if (analyst_settings.streaming) {
+        try {
+            StripSegmenter segmenter(analyst_settings);
+            segmenter.segment(bfs::absolute(path));
+            columns = segmenter.columns();
+            rows = segmenter.rows();
+            wsize = segmenter.get_window_size();
+            segmenter.get_centroids(centroids);
+            streamed = true;
+        } catch(UnsupportedStream& e) {
+            std::ostringstream msg;
+            msg << e.what() << ", segmenting whole image instead";
+            logger->message(msg.str(), warningLevel);
+        }
+    }
+    if (not(streamed)) {
+        std::auto_ptr<ImageAnalyst> \
+            analyst(new ImageAnalyst(bfs::absolute(path), 
+                analyst_settings));
+        analyst->segment();
+        columns = analyst->columns();
+        rows = analyst->rows();
+        wsize = analyst->get_window_size();
+        analyst->get_centroids(centroids);
+    }
 	
-	// Get centroids and dump to file if required 
+	// Dump centroids to file if required 
 	if (settings.output) {   
 	    std::ostringstream msg; 
         msg << "Dumping segment centroids to " << settings.outputfile;
         logger->message(msg.str(), traceLevel);
         
-        // Get segmentation window size
-        blitz::TinyVector<int, 4> wsize = analyst->get_window_size();
+        // Note where this frame starts for the frame index
+        const boost::uint64_t offset = bfs::exists(settings.outputfile) ? 
+            bfs::file_size(settings.outputfile) : 0;
         
         // Open dumpfile as stream, add path, altered path and image and 
         // window sizes  
         std::fstream dumpFileStream;
         dumpFileStream.open(settings.outputfile.string().c_str(), 
             std::fstream::out | std::fstream::app); 
-        dumpFileStream << "{'original_file': '" << path.string()
+        dumpFileStream << "{'sequence': " << sequence 
+                       << ", 'original_file': '" << path.string()
                        << "', 'segmented_file': '" 
                        << path.stem() << "_segments" << bfs::extension(path) 
                        << "', 'image_size': (" 
-                       << analyst->columns() << ", " << analyst->rows() 
+                       << columns << ", " << rows 
                        << "), 'window_size': (" << wsize[0] << ", " 
                        << wsize[1] << ", " << wsize[2] << ", " 
                        << wsize[3] << "), ";
         
-        // Get centroids, push to file
-        std::vector<Index> centroids;
-        analyst->get_centroids(centroids); 
+        // Push centroids to file
         dumpFileStream << "'centroids': [";
         foreach(Index index, centroids)
             dumpFileStream << "(" << index[0] << "," << index[1] << "), ";
@@ -87,6 +242,10 @@ void Crawler::analyse_image(const bfs::path& path)
         // Clean up
         dumpFileStream.flush();
         dumpFileStream.close();
+        
+        // Record frame in index once its line is complete
+        append_frame_index(settings.outputfile, offset, sequence, 
+            centroids.size());
     }
     
     // Exit
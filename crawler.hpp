@@ -11,27 +11,54 @@
 #include "common.hpp"
 #include "logger.hpp"
 #include "analyst.hpp"  
+#include "strips.hpp"
+#include "frame_index.hpp"
+
+// How matched files are split between shards
+enum ShardMode {
+    hashShards,  // by stable hash of each file's path
+    rangeShards  // by contiguous ranges of the sorted file list
+};
 
 typedef struct {
     boost::regex matchRegex; 
     bool recursive; 
     bool output; 
     bfs::path outputfile;
+    int shardIndex, shardCount; // this process handles shard i of N
+    ShardMode shardMode;
 } CrawlerSettings;
 
+// A matched file, with its path relative to the search path as a key
+typedef struct {
+    bfs::path path;
+    std::string key;
+    std::size_t searchPath; // index of the search path it was found under
+} MatchedFile;
+
 // = Class interface =
 class Crawler {
 public: 
     Crawler(const CrawlerSettings& s, const AnalystSettings& as);
     virtual ~Crawler();      
     void operator()(const bfs::path& p);     
-    void analyse_image(const bfs::path& f);
+    void process(bool skipFailures=false);
+    void add_file(const bfs::path& path);
+    void analyse_image(const bfs::path& f, std::size_t sequence);
     
 private:   
-    const CrawlerSettings settings;
+    CrawlerSettings settings;
     const AnalystSettings analyst_settings;
+    std::vector<MatchedFile> matchedFiles;
+    std::set<std::string> matchedPaths; // files matched by this crawl
+    std::set<std::string> seenFiles;    // every file analysed so far
+    std::size_t nextSequence;        // sequence number for the next new file
+    std::size_t nSearchPaths;        // search paths crawled so far
     
     // Private methods    
+    void _traverse(const bfs::path& path, const bfs::path& root);
+    MatchedFile _make_file(const bfs::path& path, const bfs::path& root);
+    bool _in_shard(const MatchedFile& file, std::size_t sequence);
     inline bool _match_regex(bfs::path path) {
         return boost::regex_search(to_string(path), settings.matchRegex);
     }
@@ -45,6 +72,13 @@ private:
         msg << "Changed " << path;
         logger->message(msg.str(), traceLevel);
     }
+    inline void _failure_message(const bfs::path& path, 
+        const std::exception& e) 
+    {
+        std::ostringstream msg;
+        msg << "Couldn't analyse " << path << ": " << e.what();
+        logger->message(msg.str(), warningLevel);
+    }
     inline void _dump_message(const bfs::path& path) {
         std::ostringstream msg;
         msg << "Dumping " << path << " to output file " << settings.outputfile;
@@ -76,5 +110,18 @@ public:
 private:
     const bfs::path _path;
 };
+class InvalidShardSpec: public std::exception {
+public:
+    InvalidShardSpec(int index, int count) { 
+        std::ostringstream msg;
+        msg << "Invalid shard specification: " << index << "/" << count
+            << " (need 0 <= i < N)";
+        _msg = msg.str();
+    } 
+    virtual ~InvalidShardSpec() throw() { /* pass */ }
+    virtual const char* what() const throw() { return _msg.c_str(); }
+private:
+    std::string _msg;
+};
 
 #endif /* end of include guard: CRAWLER_HPP_K7OISOXZ */
@@ -7,11 +7,13 @@
 
 import sys
 import getopt                             
+from os.path import exists
 from numpy import sqrt, linspace, nan, transpose, vectorize, meshgrid
 from matplotlib.pyplot import figure, subplot
 from matplotlib.mlab import griddata       
 from matplotlib.cm import RdYlGn as myColorMap 
 from matplotlib.gridspec import GridSpec
+from frame_index import FrameIndex, index_path
               
 # ==> Usage exception class and help message =================================
 
@@ -84,22 +86,46 @@ class PositionAnalyser(object):
                                  #     is complete
         self.entryGutters = {'right': 50}
         self.exitGutters = {'left': 50} 
-            
-        centroidImageDict = eval(open(self.centroidsFile, 'r').readline())
+        
+        # Use the frame index for random access to frames if there is one.
+        # The header then comes from the first indexed frame, since earlier 
+        # lines may belong to an older run which the index doesn't cover.
+        self.frameIndex = None
+        if exists(index_path(self.centroidsFile)):
+            self.frameIndex = FrameIndex(self.centroidsFile)
+        if self.frameIndex is not None and len(self.frameIndex) > 0:
+            centroidImageDict = \
+                self.frameIndex.read_frame(self.frameIndex.frames[0])
+        else:
+            centroidImageDict = eval(open(self.centroidsFile, 'r').readline())
         self.imageSize = centroidImageDict['image_size']
         self.windowSize = centroidImageDict['window_size']  
     
-    def extract_trails(self): 
+    def extract_trails(self, firstFrame=None, lastFrame=None): 
         """ Reads in the given dumpfile, parses the dictionaries of locations 
             for each frame and updates the trails with the new locations.
+            
+            If firstFrame or lastFrame are given, only frames in that range 
+            are used. With a frame index only the frames in the range are 
+            read, otherwise every line in the file is read.
         """ 
         if self.centroidsFile is None: 
             msg = "No centroid file found!" + \
                   "\n\t For help use --help".format(self.centroidsFile)
             raise Usage(msg)
         try:
-            for line in open(self.centroidsFile, 'r'):    
-                self.__update_trails(line)
+            if self.frameIndex is not None:
+                for frame in self.frameIndex.read_frames(firstFrame, lastFrame):
+                    self.__update_trails(frame)
+            else:
+                for line in open(self.centroidsFile, 'r'):    
+                    if line[0] == '#': continue
+                    frame = eval(line)
+                    if firstFrame is not None \
+                        and frame.get('sequence', 0) < firstFrame: continue
+                    if lastFrame is not None \
+                        and frame.get('sequence', 0) > lastFrame: continue
+                    self.__update_trails(frame)
             
             # Copy out all extracted trails to self.trails attribute
             self.trails = self.completeTrails + self.liveTrails          
@@ -140,13 +166,10 @@ class PositionAnalyser(object):
                   "\n\t For help use --help".format(outputFile, e)
             raise Usage(e) 
     
-    def __update_trails(self, line):
-        """ Updates trails with the positions in line. Utility function only 
-            called from self.__extract_trails.
+    def __update_trails(self, centroidImageDict):
+        """ Updates trails with the positions in a frame's dictionary. Utility 
+            function only called from self.__extract_trails.
         """
-        # Read in data from file - one line per image 
-        if line[0] == '#': return
-        centroidImageDict = eval(line)
         positions = centroidImageDict['centroids']  
         if len(positions) == 0: return
         
@@ -320,6 +343,31 @@ class PositionPlotter(object):
         self.axes.set_aspect('auto')
         self.figure.savefig(output + '_velocity_curve.pdf')
     
+def plot_velocity_field(fieldFile, output='test'):
+    """ Contours the mean velocity magnitude from a velocity field file 
+        written by ./process_images --trails.
+        
+        The field is already gridded, so unlike PositionPlotter.velocity_map 
+        this doesn't need the individual velocities in memory. Empty cells 
+        are left blank.
+    """
+    from scipy.io import netcdf_file # only needed for field files
+    field = netcdf_file(fieldFile, 'r', mmap=False)
+    xs, ys = field.variables['x'][:], field.variables['y'][:]
+    counts = field.variables['count'][:]
+    magVel = sqrt(field.variables['mean_u'][:]**2 
+                  + field.variables['mean_v'][:]**2)
+    magVel[counts == 0] = nan
+    field.close()
+    
+    fig = figure(figsize=(10,3))
+    axes = fig.gca()
+    csf = axes.contourf(xs, ys, magVel, cmap=myColorMap)
+    cbar = fig.colorbar(csf) 
+    cbar.set_label("Velocity magnitude, mm/s")
+    axes.set_aspect('equal')
+    fig.savefig(output + '_velocity_field.pdf')
+
 
 
 # ==> Main routine =========================================================== 
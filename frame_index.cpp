@@ -0,0 +1,62 @@
+/*
+    frame_index.cpp (ImageAnalyst)
+    Jess Robertson, 2026-10-18
+    
+    Writer for results file frame indices
+*/
+
+#include "frame_index.hpp"
+
+// Write the low nBytes of value to a stream, least significant byte first
+static void write_little_endian(std::ostream& stream, boost::uint64_t value, 
+    int nBytes) 
+{
+    for (int i = 0; i < nBytes; ++i)
+        stream.put(char((value >> (8*i)) & 0xff));
+}
+
+// Read the frame number of the last record in an index, returning false 
+// if the index is unreadable or has no records
+static bool read_last_frame(const bfs::path& indexFile, 
+    boost::uint32_t& frame) 
+{
+    std::ifstream indexStream(indexFile.string().c_str(), std::ios::binary);
+    char magic[frameIndexMagicSize];
+    if (not(indexStream.read(magic, frameIndexMagicSize)) 
+        || not(std::equal(magic, magic + frameIndexMagicSize, frameIndexMagic)))
+        return false;
+    indexStream.seekg(0, std::ios::end);
+    const std::streamoff size = indexStream.tellg();
+    if (size < std::streamoff(frameIndexMagicSize + 16)) return false;
+    
+    // Frame number is the middle field of the last 16 byte record
+    unsigned char bytes[4];
+    indexStream.seekg(size - 8);
+    if (not(indexStream.read(reinterpret_cast<char*>(bytes), 4))) 
+        return false;
+    frame = 0;
+    for (int i = 3; i >= 0; --i) frame = (frame << 8) | bytes[i];
+    return true;
+}
+
+void append_frame_index(const bfs::path& resultsFile, boost::uint64_t offset,
+    boost::uint32_t frame, boost::uint32_t blobCount)
+{
+    // A frame at offset zero starts a new results file, so any existing 
+    // index is stale. A frame numbered no higher than the last indexed 
+    // frame starts a new run appended to the results file.
+    const bfs::path indexFile = frame_index_path(resultsFile);
+    boost::uint32_t lastFrame;
+    const bool newIndex = (offset == 0) 
+        || not(read_last_frame(indexFile, lastFrame)) || frame <= lastFrame;
+    std::ofstream indexStream;
+    indexStream.open(indexFile.string().c_str(), newIndex ? 
+        std::ios::out | std::ios::binary | std::ios::trunc :
+        std::ios::out | std::ios::binary | std::ios::app);
+    if (newIndex)
+        indexStream.write(frameIndexMagic, frameIndexMagicSize);
+    write_little_endian(indexStream, offset, 8);
+    write_little_endian(indexStream, frame, 4);
+    write_little_endian(indexStream, blobCount, 4);
+    indexStream.close();
+}
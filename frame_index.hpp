@@ -0,0 +1,41 @@
+/*
+    frame_index.hpp (ImageAnalyst)
+    Jess Robertson, 2026-10-18
+    
+    Binary index written alongside a results (dump) file, so that readers 
+    can seek straight to a given frame instead of parsing every line 
+    before it. The index file is the results file name with ".idx" 
+    appended, and holds an 8 byte magic string followed by one 16 byte 
+    little-endian record per frame:
+        uint64  byte offset of the frame's line in the results file
+        uint32  frame (sequence) number
+        uint32  number of blobs in the frame
+    Records are appended in the order frames are written, so frame 
+    numbers increase through the index. Results files are opened for 
+    appending, so a later run can add frames which restart the numbering. 
+    Since frame numbers would then be ambiguous the index is restarted, 
+    and covers only the frames of the latest run. See frame_index.py for 
+    the reader.
+*/
+
+#ifndef FRAME_INDEX_HPP_9QF4ZC2B
+#define FRAME_INDEX_HPP_9QF4ZC2B
+
+#include "common.hpp"
+#include <boost/cstdint.hpp>
+
+static const char frameIndexMagic[] = "BLOBIDX1";
+static const std::size_t frameIndexMagicSize = 8;
+
+// Index file name for a given results file
+inline bfs::path frame_index_path(const bfs::path& resultsFile) {
+    return bfs::path(resultsFile.string() + ".idx");
+}
+
+// Append a record to the index for resultsFile, starting a new index if 
+// the results file was empty before this frame was written or the frame 
+// doesn't follow on from the last indexed frame
+void append_frame_index(const bfs::path& resultsFile, boost::uint64_t offset,
+    boost::uint32_t frame, boost::uint32_t blobCount);
+
+#endif /* end of include guard: FRAME_INDEX_HPP_9QF4ZC2B */
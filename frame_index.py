@@ -0,0 +1,93 @@
+#!/usr/bin/env python
+# encoding: utf-8
+# Jess Robertson, 2026-10-18
+#
+# Contains FrameIndex class which reads the binary frame index written by
+# process_images alongside its dump file, giving random access to frames.
+
+import struct
+
+# ==> Index format ===========================================================
+
+# Index files hold this magic string followed by one record per frame (see
+# frame_index.hpp)
+indexMagic = b'BLOBIDX1'
+indexRecord = struct.Struct('<QII') # offset, frame number, blob count
+
+def index_path(resultsFile):
+    """ Returns the name of the index file for the given results file.
+    """
+    return resultsFile + '.idx'
+
+def write_index_record(indexFile, offset, frame, blobCount):
+    """ Writes a single index record to the open (binary) index file.
+    """
+    indexFile.write(indexRecord.pack(offset, frame, blobCount))
+
+
+# ==> Reader class ===========================================================
+
+class FrameIndex(object):
+    """ Random access to the frames in a ./process_images dump file.
+
+        The index is loaded in one read, after which any frame can be read
+        with a single seek, so reading part of a long run costs time
+        proportional to the number of frames requested rather than the
+        size of the file. Frames are looked up by number rather than by
+        position in the index, so gaps in the numbering (e.g. from
+        sharding) don't matter.
+    """
+    def __init__(self, resultsFile):
+        super(FrameIndex, self).__init__()
+        self.resultsFile = resultsFile
+        indexFile = open(index_path(resultsFile), 'rb')
+        if indexFile.read(len(indexMagic)) != indexMagic:
+            raise IOError("Not a frame index: " + index_path(resultsFile))
+        data = indexFile.read()
+        indexFile.close()
+        nRecords = len(data) // indexRecord.size
+        self.offsets, self.frames, self.blobCounts = [], [], []
+        for i in range(nRecords):
+            offset, frame, blobCount = \
+                indexRecord.unpack_from(data, i*indexRecord.size)
+            self.offsets.append(offset)
+            self.frames.append(frame)
+            self.blobCounts.append(blobCount)
+        self.positions = dict((f, i) for i, f in enumerate(self.frames))
+
+    def __len__(self):
+        return len(self.frames)
+
+    def blob_count(self, frame):
+        """ Returns the number of blobs in the given frame, without reading
+            the results file.
+        """
+        return self.blobCounts[self.__position(frame)]
+
+    def read_frame(self, frame):
+        """ Returns the record dictionary for the given frame number.
+        """
+        results = open(self.resultsFile, 'r')
+        results.seek(self.offsets[self.__position(frame)])
+        record = eval(results.readline())
+        results.close()
+        return record
+
+    def read_frames(self, firstFrame=None, lastFrame=None):
+        """ Generates the record dictionaries for frames numbered from
+            firstFrame to lastFrame inclusive, in the order they were
+            written. Either end may be None to leave the range open.
+        """
+        results = open(self.resultsFile, 'r')
+        for frame, offset in zip(self.frames, self.offsets):
+            if firstFrame is not None and frame < firstFrame: continue
+            if lastFrame is not None and frame > lastFrame: continue
+            results.seek(offset)
+            yield eval(results.readline())
+        results.close()
+
+    def __position(self, frame):
+        try:
+            return self.positions[frame]
+        except KeyError:
+            raise KeyError("Frame {0} is not in the index".format(frame))
@@ -0,0 +1,174 @@
+/*
+    labeler.cpp (ImageAnalyst)
+    Jess Robertson, 2026-10-18
+
+    Implementation of RunLabeler methods
+*/
+
+#include "labeler.hpp"
+
+// Ctor
+RunLabeler::RunLabeler(int c): connectivity(c), maxLabel(0) {
+    if (connectivity != 4 && connectivity != 8)
+        throw InvalidConnectivity(connectivity);
+}
+
+/*  Labels the connected components in a mask. Each row is scanned for 
+    foreground runs using find_runs, which only touches non-empty words 
+    in the mask, and we note where each non-empty row starts. Since every 
+    run can start at most one label, the run count tells us whether 16-bit 
+    labels are wide enough, and we dispatch to the matching LabelKernel.
+*/
+void RunLabeler::label(const BinaryMask& mask) {
+    runs.clear();
+    rowStarts.clear();
+    for (int y = 0; y < mask.height(); ++y) {
+        const std::size_t rowStart = runs.size();
+        find_runs(mask.row(y), mask.words_per_row(), mask.width(), y, runs);
+        if (runs.size() != rowStart) rowStarts.push_back(rowStart);
+    }
+    rowStarts.push_back(runs.size());
+    
+    // Dispatch on label width and connectivity
+    const std::size_t shortLimit = \
+        std::numeric_limits<boost::uint16_t>::max();
+    const bool shortLabels = runs.size() < shortLimit;
+    if (connectivity == 4)
+        maxLabel = shortLabels ? kernel4Short(runs, rowStarts) 
+                               : kernel4Long(runs, rowStarts);
+    else 
+        maxLabel = shortLabels ? kernel8Short(runs, rowStarts) 
+                               : kernel8Long(runs, rowStarts);
+}
+
+// = StreamingLabeler =
+StreamingLabeler::StreamingLabeler(int connectivity): row(0) {
+    if (connectivity != 4 && connectivity != 8)
+        throw InvalidConnectivity(connectivity);
+    reach = (connectivity == 8) ? 1 : 0;
+}
+
+/*  Labels a row of the mask. This is the same sweep as LabelKernel, but 
+    rather than provisional labels the runs carry the slot of their open 
+    component, and run statistics are added to the slots as we go.
+*/
+void StreamingLabeler::push_row(const MaskWord* bits, int width) {
+    currentRuns.clear();
+    find_runs(bits, (width + maskWordBits - 1)/maskWordBits, width, row, 
+        currentRuns);
+    
+    std::size_t p = 0;
+    foreach(Run& run, currentRuns) {
+        int slot = -1;
+        while (p < previousRuns.size() 
+               && previousRuns[p].end + reach <= run.begin) 
+            ++p;
+        for (std::size_t q = p; q < previousRuns.size(); ++q) {
+            if (previousRuns[q].begin >= run.end + reach) break;
+            const int neighbour = _find_root(previousRuns[q].label);
+            slot = (slot < 0) ? neighbour : _merge(slot, neighbour);
+        }
+        if (slot < 0) slot = _new_slot(run);
+        run.label = slot;
+        
+        // Add run to its component's statistics
+        BlobStats& stats = slots[slot];
+        const double length = run.end - run.begin;
+        stats.area += length;
+        stats.sumI += 0.5*(run.begin + run.end - 1)*length;
+        stats.sumJ += double(row)*length;
+        stats.bounds[0] = std::min(stats.bounds[0], run.begin);
+        stats.bounds[1] = std::max(stats.bounds[1], run.end);
+        stats.bounds[3] = row + 1;
+    }
+    _close_finished();
+    previousRuns.swap(currentRuns);
+    ++row;
+}
+static bool first_run_less(const BlobStats& a, const BlobStats& b) {
+    return (a.firstRow < b.firstRow) 
+        || (a.firstRow == b.firstRow && a.firstBegin < b.firstBegin);
+}
+void StreamingLabeler::finish() {
+    // Nothing in the (empty) next row continues any component
+    currentRuns.clear();
+    _close_finished();
+    previousRuns.clear();
+    
+    // Restore raster order of first runs
+    std::sort(blobs.begin(), blobs.end(), first_run_less);
+}
+
+/*  Tidies up after a row. Current runs are pointed at their root slots, 
+    and then each slot used by the previous row is either still open (it 
+    is the root of a current run), merged away (not a root) or finished 
+    (a root with no current runs). Finished components are written out 
+    and merged or finished slots are freed.
+*/
+void StreamingLabeler::_close_finished() {
+    foreach(Run& run, currentRuns) {
+        run.label = _find_root(run.label);
+        lastSeen[run.label] = row;
+    }
+    foreach(const Run& run, previousRuns) {
+        const int slot = run.label;
+        if (parents[slot] < 0) continue; // already freed
+        if (parents[slot] == slot) {
+            if (lastSeen[slot] == row) continue;
+            blobs.push_back(slots[slot]);
+        }
+        parents[slot] = -1;
+        freeSlots.push_back(slot);
+    }
+}
+
+int StreamingLabeler::_new_slot(const Run& run) {
+    BlobStats stats = {0, 0, 0, row, run.begin, 
+        Box(run.begin, run.end, row, row + 1)};
+    int slot;
+    if (freeSlots.empty()) {
+        slot = int(slots.size());
+        slots.push_back(stats);
+        parents.push_back(slot);
+        lastSeen.push_back(-1);
+    } else {
+        slot = freeSlots.back();
+        freeSlots.pop_back();
+        slots[slot] = stats;
+        parents[slot] = slot;
+        lastSeen[slot] = -1;
+    }
+    return slot;
+}
+int StreamingLabeler::_find_root(int slot) {
+    int root = slot;
+    while (parents[root] != root) root = parents[root];
+    while (parents[slot] != root) {
+        const int next = parents[slot];
+        parents[slot] = root;
+        slot = next;
+    }
+    return root;
+}
+int StreamingLabeler::_merge(int a, int b) {
+    // Fold b's statistics into a, keeping the earliest first run
+    a = _find_root(a);
+    b = _find_root(b);
+    if (a == b) return a;
+    BlobStats& A = slots[a];
+    const BlobStats& B = slots[b];
+    A.area += B.area;
+    A.sumI += B.sumI;
+    A.sumJ += B.sumJ;
+    if (B.firstRow < A.firstRow 
+        || (B.firstRow == A.firstRow && B.firstBegin < A.firstBegin)) {
+        A.firstRow = B.firstRow;
+        A.firstBegin = B.firstBegin;
+    }
+    A.bounds = Box(std::min(A.bounds[0], B.bounds[0]), 
+                   std::max(A.bounds[1], B.bounds[1]),
+                   std::min(A.bounds[2], B.bounds[2]), 
+                   std::max(A.bounds[3], B.bounds[3]));
+    parents[b] = a;
+    return a;
+}
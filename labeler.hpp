@@ -0,0 +1,215 @@
+/*
+    labeler.hpp (ImageAnalyst)
+    Jess Robertson, 2026-10-18
+
+    Connected component labeling over the foreground runs of a BinaryMask.
+    The labeling kernel is a template on the connectivity (4 or 8), so the
+    neighbour test in the inner sweep is fixed at compile time, and on the
+    integer type of its union-find forest. RunLabeler picks the narrowest
+    type that can hold every provisional label in a given frame.
+*/
+
+#ifndef LABELER_HPP_5T2KVJ8M
+#define LABELER_HPP_5T2KVJ8M
+
+#include "common.hpp"
+#include "types.hpp"
+#include "mask.hpp"
+
+/*  = Labeling kernel =
+    Labels runs (which must be in raster order) in place. The labeling
+    proceeds as follows:
+    1. Each run is compared with the runs in the previous row. Since both
+       rows are sorted by column we can sweep them together, so this costs
+       time proportional to the number of runs. Runs are neighbours if
+       they overlap, or for 8-connectivity if they overlap when extended
+       by one pixel. There are no image borders to test since runs never
+       extend outside the mask.
+        -- If a run has no neighbours it starts a new provisional label.
+        -- Otherwise it takes the label of its first neighbour, and any other
+           neighbouring labels are merged into it in the union-find forest.
+    2. Provisional labels are resolved to their roots and renumbered from 1
+       in order of first appearance.
+    Provisional labels are kept in the runs themselves, so the only extra
+    storage is the union-find forest, which is the array chased at random
+    by every merge and lookup. Its entries are LabelType, and since every
+    run can start at most one provisional label LabelType must be able to
+    hold runs.size() + 1 values. Returns the number of labels.
+*/
+template<int Connectivity, typename LabelType>
+class LabelKernel {
+public:
+    Label operator()(std::vector<Run>& runs,
+        const std::vector<std::size_t>& rowStarts)
+    {
+        // Runs touch a neighbour this many pixels beyond their ends
+        const int reach = (Connectivity == 8) ? 1 : 0;
+
+        parents.assign(1, LabelType(0)); // label 0 is the background
+        for (std::size_t r = 0; r + 1 < rowStarts.size(); ++r) {
+            const std::size_t currentBegin = rowStarts[r],
+                              currentEnd = rowStarts[r + 1];
+            const bool adjacent = (r > 0) &&
+                (runs[rowStarts[r - 1]].row + 1 == runs[currentBegin].row);
+            std::size_t p = adjacent ? rowStarts[r - 1] : currentBegin;
+            const std::size_t previousEnd = adjacent ? currentBegin : p;
+
+            // Sweep current runs against the previous row's runs
+            for (std::size_t c = currentBegin; c < currentEnd; ++c) {
+                Run& run = runs[c];
+                Label label = 0;
+
+                // Skip previous runs which end before this one can touch
+                // them
+                while (p < previousEnd && runs[p].end + reach <= run.begin)
+                    ++p;
+                for (std::size_t q = p; q < previousEnd; ++q) {
+                    if (runs[q].begin >= run.end + reach) break;
+                    if (label == 0) label = runs[q].label;
+                    else _merge(label, runs[q].label);
+                }
+
+                // No neighbours, so start a new label
+                if (label == 0) {
+                    label = Label(parents.size());
+                    parents.push_back(LabelType(label));
+                }
+                run.label = label;
+            }
+        }
+
+        // Resolve provisional labels and renumber them consecutively
+        std::vector<Label> finalLabels(parents.size(), Label(0));
+        Label maxLabel = 0;
+        foreach(Run& run, runs) {
+            const Label root = _find_root(run.label);
+            if (finalLabels[root] == 0) finalLabels[root] = ++maxLabel;
+            run.label = finalLabels[root];
+        }
+        return maxLabel;
+    }
+
+private:
+    // Union-find forest over the provisional labels
+    std::vector<LabelType> parents;
+
+    // Union-find helpers
+    inline Label _find_root(Label label) {
+        Label root = label;
+        while (Label(parents[root]) != root) root = parents[root];
+
+        // Compress path so later lookups are quick
+        while (Label(parents[label]) != root) {
+            const Label next = parents[label];
+            parents[label] = LabelType(root);
+            label = next;
+        }
+        return root;
+    }
+    inline void _merge(Label a, Label b) {
+        // Always keep the smaller label as the root
+        a = _find_root(a);
+        b = _find_root(b);
+        if (a < b) parents[b] = LabelType(a);
+        else if (b < a) parents[a] = LabelType(b);
+    }
+};
+
+// = Class interface =
+class RunLabeler {
+public:
+    RunLabeler(int connectivity=8);
+
+    // Label the foreground runs in the given mask
+    void label(const BinaryMask& mask);
+
+    // Accessors - labels run from 1 to get_maximum_label(), and runs are
+    // stored in raster order
+    inline const std::vector<Run>& get_runs() const { return runs; }
+    inline Label get_maximum_label() const { return maxLabel; }
+
+private:
+    // Data
+    int connectivity;
+    std::vector<Run> runs;
+    std::vector<std::size_t> rowStarts; // first run in each non-empty row
+    Label maxLabel;
+
+    // Kernels for each connectivity and label width
+    LabelKernel<4, boost::uint16_t> kernel4Short;
+    LabelKernel<4, boost::uint32_t> kernel4Long;
+    LabelKernel<8, boost::uint16_t> kernel8Short;
+    LabelKernel<8, boost::uint32_t> kernel8Long;
+};
+
+// = Blob statistics =
+/*  Summary of a connected component, in the coordinates of the mask. The 
+    first run is the component's first run in raster order, which gives 
+    the same blob ordering as RunLabeler's labels.
+*/
+struct BlobStats {
+    double area, sumI, sumJ;   // pixel count and sums of pixel indices
+    int firstRow, firstBegin;  // first run in raster order
+    Box bounds;                // (iMin, iMax, jMin, jMax), max exclusive
+};
+
+/*  = Streaming labeler =
+    Labels a mask which arrives one row at a time, keeping only the runs 
+    in the previous row and the statistics of components which are still 
+    open. A component is finished as soon as a row contains none of its 
+    runs, since no later run can reach it, and its statistics are added 
+    to the list returned by get_blobs. Memory is proportional to the 
+    width of the mask and the number of open components rather than the 
+    height of the mask.
+    
+    Open components live in recycled slots. Slots which are merged 
+    together within a row form a union-find forest; once the row is done 
+    every current run points at a root slot, so merged-away slots can be 
+    freed.
+*/
+class StreamingLabeler {
+public:
+    StreamingLabeler(int connectivity=8);
+    
+    // Label the next row of the mask, which has the given width in pixels
+    void push_row(const MaskWord* bits, int width);
+    
+    // Finish all open components after the last row
+    void finish();
+    
+    // Finished blobs, ordered by their first run in raster order once 
+    // finish has been called
+    inline const std::vector<BlobStats>& get_blobs() const { return blobs; }
+    
+private:
+    // Data
+    int reach; // how far runs reach for neighbours (1 for 8-connectivity)
+    int row;
+    std::vector<Run> previousRuns, currentRuns; // label is the slot
+    std::vector<BlobStats> slots;
+    std::vector<int> parents, freeSlots, lastSeen;
+    std::vector<BlobStats> blobs;
+    
+    // Helpers
+    int _new_slot(const Run& run);
+    int _find_root(int slot);
+    int _merge(int a, int b);
+    void _close_finished();
+};
+
+// = Exceptions =
+class InvalidConnectivity: public std::exception {
+public:
+    InvalidConnectivity(int connectivity) {
+        std::ostringstream msg;
+        msg << "Connectivity must be 4 or 8 (got " << connectivity << ")";
+        _msg = msg.str();
+    }
+    virtual ~InvalidConnectivity() throw() { /* pass */ }
+    virtual const char* what() const throw() { return _msg.c_str(); }
+
+private:
+    std::string _msg;
+};
+
+#endif /* end of include guard: LABELER_HPP_5T2KVJ8M */
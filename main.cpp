@@ -5,6 +5,8 @@
 
 #include "common.hpp"
 #include "crawler.hpp"       
+#include "watcher.hpp"
+#include "velocity.hpp"
 #include "logger.hpp" 
 
 // Pattern for jpeg files
@@ -18,10 +20,16 @@ int main (int argc, char *argv[]) {
     // Declare some options variables
     bool recurse = false, dump = false;  
     double thresholdFraction;
-    int blobSize;
+    int blobSize, connectivity;
     bfs::path dumpFile = "dump.py";
     std::vector<bfs::path> directories;  
-    std::string regex;
+    std::string regex, shard, shardMode, thresholdMode;
+    int thresholdWindow, pyramidLevels;
+    double sauvolaK, pyramidTolerance;
+    std::vector<bfs::path> trailFiles, fieldFiles;
+    bfs::path fieldFile = "velocity_field.nc";
+    int velocityFrames;
+    double secondsPerFrame, millimetersPerPixel;
     
     // Set up variable descriptions
     bpo::options_description visible(\
@@ -31,15 +39,51 @@ int main (int argc, char *argv[]) {
         ("regex", bpo::value(&regex),                                   \
          "provides a regular expression to match filenames against")    \
         ("recursive", "sets whether trees are traversed recursively")   \
+        ("watch", "keep watching directories and process new files "    \
+         "(not with --shard)")                                          \
         ("save-segments", "whether to save segmented image file")       \
+        ("stream", "segment images in row strips to bound memory use")  \
         ("threshold", bpo::value<double>(&thresholdFraction),           \
          "sets thresholding fraction for blob extraction")              \
+        ("threshold-mode", bpo::value(&thresholdMode),                  \
+         "thresholding mode (global, mean or sauvola)")                 \
+        ("threshold-window", bpo::value<int>(&thresholdWindow),         \
+         "local threshold window radius, in multiples of blob size")    \
+        ("sauvola-k", bpo::value<double>(&sauvolaK),                    \
+         "sets k parameter for Sauvola thresholding")                   \
         ("window", bpo::value< std::vector<int> >()->multitoken(),      \
          "window from which blobs are extracted (=x1 x2 y1 y2)")        \
         ("size", bpo::value<int>(&blobSize),                            \
          "blob size (in pixels) to use for blob extraction")            \
+        ("pyramid", bpo::value<int>(&pyramidLevels),                    \
+         "find blobs on image downsampled by 2^n first (0 = off)")      \
+        ("pyramid-tolerance", bpo::value<double>(&pyramidTolerance),    \
+         "centroid tolerance (in pixels) for pyramid blobs")            \
+        ("connectivity", bpo::value<int>(&connectivity),                \
+         "pixel connectivity (4 or 8) used to join pixels into blobs")  \
         ("output", bpo::value<bfs::path>(&dumpFile),                    \
-         "file into which program should dump data");
+         "file into which program should dump data")                    \
+        ("shard", bpo::value(&shard),                                   \
+         "only process shard i of N of the matched files (=i/N)")       \
+        ("shard-mode", bpo::value(&shardMode),                          \
+         "how files are split between shards (hash or range)");
+    bpo::options_description velocity("Velocity field options");
+    velocity.add_options()                                              \
+        ("trails", bpo::value(&trailFiles)->multitoken(),               \
+         "accumulate velocity field from trail files")                  \
+        ("merge-fields", bpo::value(&fieldFiles)->multitoken(),         \
+         "merge saved velocity fields (and any --trails) into one")     \
+        ("field-output", bpo::value<bfs::path>(&fieldFile),             \
+         "file into which velocity field is written")                   \
+        ("velocity-frames", bpo::value<int>(&velocityFrames),           \
+         "number of frames to calculate velocities over")               \
+        ("seconds-per-frame", bpo::value<double>(&secondsPerFrame),     \
+         "time between frames (in seconds)")                            \
+        ("mm-per-pixel", bpo::value<double>(&millimetersPerPixel),      \
+         "image scale (in millimeters per pixel)")                      \
+        ("bins", bpo::value< std::vector<int> >()->multitoken(),        \
+         "velocity grid size (=nx ny), gridded over --window");
+    visible.add(velocity);
     bpo::options_description hidden("Hidden options");
     hidden.add_options()("search-path", \
         bpo::value< std::vector<bfs::path> >(&directories), "search path");
@@ -66,6 +110,62 @@ int main (int argc, char *argv[]) {
             return 1;
         }                             
         
+        // Accumulate velocity field from trails and/or saved fields. Saved 
+        // fields carry their own grid and parameters, otherwise these come 
+        // from the options with the grid covering --window.
+        if (varMap.count("trails") || varMap.count("merge-fields")) {
+            std::auto_ptr<VelocityField> field;
+            if (fieldFiles.size() > 0) {
+                field.reset(new VelocityField(fieldFiles[0]));
+                for (std::size_t i = 1; i < fieldFiles.size(); ++i)
+                    field->merge(VelocityField(fieldFiles[i]));
+            } else {
+                VelocitySettings velocity_settings;
+                velocity_settings.nFrames = 5;
+                velocity_settings.secondsPerFrame = 0.1;
+                velocity_settings.millimetersPerPixel = 2.95;
+                velocity_settings.nBinsX = 50;
+                velocity_settings.nBinsY = 50;
+                if (varMap.count("velocity-frames")) {
+                    if (velocityFrames < 1)
+                        throw bpo::invalid_option_value("velocity-frames");
+                    velocity_settings.nFrames = velocityFrames;
+                }
+                if (varMap.count("seconds-per-frame")) {
+                    if (not(secondsPerFrame > 0))
+                        throw bpo::invalid_option_value("seconds-per-frame");
+                    velocity_settings.secondsPerFrame = secondsPerFrame;
+                }
+                if (varMap.count("mm-per-pixel")) {
+                    if (not(millimetersPerPixel > 0))
+                        throw bpo::invalid_option_value("mm-per-pixel");
+                    velocity_settings.millimetersPerPixel = millimetersPerPixel;
+                }
+                if (varMap.count("bins")) {
+                    std::vector<int> bins = \
+                        varMap["bins"].as< std::vector<int> >();
+                    if (bins.size() != 2 || bins[0] < 1 || bins[1] < 1) 
+                        throw bpo::invalid_option_value("bins");
+                    velocity_settings.nBinsX = bins[0];
+                    velocity_settings.nBinsY = bins[1];
+                }
+                if (not(varMap.count("window"))) 
+                    throw bpo::required_option("window");
+                std::vector<int> values = \
+                    varMap["window"].as< std::vector<int> >();
+                if (values.size() != 4 || values[1] <= values[0] 
+                    || values[3] <= values[2])
+                    throw bpo::invalid_option_value("window");
+                for (int i = 0; i < 4; i++)
+                    velocity_settings.extent[i] = values[i];
+                field.reset(new VelocityField(velocity_settings));
+            }
+            foreach(bfs::path p, trailFiles)
+                field->add_trails(p);
+            field->write(fieldFile);
+            return 0;
+        }
+        
         // Traverse over supplied directories
         if (varMap.count("search-path")) {  
             // Set default crawler settings
@@ -74,6 +174,9 @@ int main (int argc, char *argv[]) {
             crawl_settings.recursive = false;
             crawl_settings.output = false;
             crawl_settings.outputfile = "output.py";  
+            crawl_settings.shardIndex = 0;
+            crawl_settings.shardCount = 1;
+            crawl_settings.shardMode = hashShards;
             
             // Set crawler settings from options
             if (varMap.count("regex")) 
@@ -85,11 +188,38 @@ int main (int argc, char *argv[]) {
                 crawl_settings.outputfile = dumpFile;  
             } 
             
+            // Set shard settings
+            if (varMap.count("shard")) {
+                char separator = 0;
+                std::istringstream spec(shard);
+                spec >> crawl_settings.shardIndex >> separator 
+                     >> crawl_settings.shardCount;
+                if (spec.fail() || separator != '/' || not(spec.eof()))
+                    throw bpo::invalid_option_value(shard);
+            }
+            if (varMap.count("watch") && crawl_settings.shardCount > 1)
+                throw bpo::error("--watch can't be used with --shard, since "
+                    "watched files are numbered in order of arrival");
+            if (varMap.count("shard-mode")) {
+                if (shardMode == "hash") 
+                    crawl_settings.shardMode = hashShards;
+                else if (shardMode == "range") 
+                    crawl_settings.shardMode = rangeShards;
+                else throw bpo::invalid_option_value(shardMode);
+            }
+            
             // Set default analyst settings
             AnalystSettings analyst_settings;
             analyst_settings.blobSize = 5;
+            analyst_settings.connectivity = 8;
+            analyst_settings.pyramidLevels = 0;
+            analyst_settings.pyramidTolerance = 1;
+            analyst_settings.thresholdMode = globalThreshold;
             analyst_settings.thresholdFraction = 0.8;
+            analyst_settings.thresholdWindow = 4;
+            analyst_settings.sauvolaK = 0.2;
             analyst_settings.saveChangedFile = false;
+            analyst_settings.streaming = false;
             analyst_settings.segmentWindow = -1; 
             
             // Set window settings
@@ -110,14 +240,55 @@ int main (int argc, char *argv[]) {
             // Set analyst settings from options
             if (varMap.count("threshold"))  
                 analyst_settings.thresholdFraction = thresholdFraction;
+            if (varMap.count("threshold-mode")) {
+                if (thresholdMode == "global") 
+                    analyst_settings.thresholdMode = globalThreshold;
+                else if (thresholdMode == "mean") 
+                    analyst_settings.thresholdMode = meanThreshold;
+                else if (thresholdMode == "sauvola") 
+                    analyst_settings.thresholdMode = sauvolaThreshold;
+                else throw bpo::invalid_option_value(thresholdMode);
+            }
+            if (varMap.count("threshold-window"))  
+                analyst_settings.thresholdWindow = thresholdWindow;
+            if (varMap.count("sauvola-k"))  
+                analyst_settings.sauvolaK = sauvolaK;
             if (varMap.count("size"))            
                 analyst_settings.blobSize = blobSize;  
+            if (varMap.count("connectivity"))
+                analyst_settings.connectivity = connectivity;
+            if (varMap.count("pyramid"))
+                analyst_settings.pyramidLevels = pyramidLevels;
+            if (varMap.count("pyramid-tolerance"))
+                analyst_settings.pyramidTolerance = pyramidTolerance;
             if (varMap.count("save-segments"))
                 analyst_settings.saveChangedFile = true;
+            if (varMap.count("stream")) {
+                analyst_settings.streaming = true;
+                if (analyst_settings.saveChangedFile 
+                    || analyst_settings.pyramidLevels > 0)
+                    logger->message("Segmented images and pyramid "
+                        "detection aren't available with --stream", 
+                        warningLevel);
+            }
             
             Crawler crawler(crawl_settings, analyst_settings); 
+            
+            // Start watching before the initial crawl so that no new 
+            // files are missed
+            std::auto_ptr<DirectoryWatcher> watcher;
+            if (varMap.count("watch")) {
+                watcher.reset(
+                    new DirectoryWatcher(crawler, crawl_settings.recursive));
+                foreach(bfs::path p, directories)
+                    watcher->add(p);
+            }
+            
+            // Files still being written when watching are retried later
             foreach(bfs::path p, directories) 
                 crawler(p); 
+            crawler.process(watcher.get() != 0);
+            if (watcher.get()) watcher->run();
         } else {
             throw InvalidDirectorySpec();
         }   
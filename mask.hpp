@@ -0,0 +1,108 @@
+/*
+    mask.hpp (ImageAnalyst)
+    Jess Robertson, 2026-10-18
+
+    Bit-packed binary mask for thresholded images. Each row is stored as a
+    sequence of 64-bit words with one bit per pixel, so a thresholded frame
+    takes 1/32 of the memory of an int-per-pixel image, and empty regions
+    can be skipped a word (64 pixels) at a time.
+*/
+
+#ifndef MASK_HPP_W3N8QX1D
+#define MASK_HPP_W3N8QX1D
+
+#include "common.hpp"
+#include "types.hpp"
+#include <boost/cstdint.hpp>
+
+typedef boost::uint64_t MaskWord;
+static const int maskWordBits = 64;
+
+// = Foreground run =
+/*  A run is a maximal horizontal segment of foreground pixels in a single
+    row of the mask, covering columns begin to end-1. The label is filled
+    in by the labeler.
+*/
+struct Run {
+    int row, begin, end;
+    Label label;
+};
+
+// = Class interface =
+class BinaryMask {
+public:
+    BinaryMask(): _width(0), _height(0), _wordsPerRow(0) { /* pass */ }
+    BinaryMask(int width, int height) { resize(width, height); }
+
+    // Resize the mask, clearing all bits
+    inline void resize(int width, int height) {
+        _width = width;
+        _height = height;
+        _wordsPerRow = (width + maskWordBits - 1) / maskWordBits;
+        _bits.assign(std::size_t(_wordsPerRow) * height, MaskWord(0));
+    }
+    inline void clear() { std::fill(_bits.begin(), _bits.end(), MaskWord(0)); }
+
+    // Bit access, x is the column and y is the row
+    inline void set(int x, int y) {
+        row(y)[x / maskWordBits] |= MaskWord(1) << (x % maskWordBits);
+    }
+    inline bool test(int x, int y) const {
+        return (row(y)[x / maskWordBits] >> (x % maskWordBits)) & 1;
+    }
+    inline MaskWord* row(int y) {
+        return &_bits[std::size_t(y) * _wordsPerRow];
+    }
+    inline const MaskWord* row(int y) const {
+        return &_bits[std::size_t(y) * _wordsPerRow];
+    }
+
+    // Accessors
+    inline int width() const { return _width; }
+    inline int height() const { return _height; }
+    inline int words_per_row() const { return _wordsPerRow; }
+
+private:
+    int _width, _height, _wordsPerRow;
+    std::vector<MaskWord> _bits;
+};
+
+/* find_runs
+   Appends the foreground runs in a packed mask row to runs. Words are
+   scanned with count-trailing-zeros to jump straight to the next 0->1 or
+   1->0 transition, so an empty word costs one comparison and a run costs
+   two bit scans, whatever its length. Runs may span word boundaries. Bits
+   past the row width must be clear.
+*/
+inline void find_runs(const MaskWord* bits, int nWords, int width, int row,
+    std::vector<Run>& runs)
+{
+    const MaskWord allOnes = ~MaskWord(0);
+    bool open = false;
+    int start = 0;
+    for (int k = 0; k < nWords; ++k) {
+        const MaskWord word = bits[k];
+        if (!open && word == 0) continue;
+        if (open && word == allOnes) continue;
+        const int base = k * maskWordBits;
+        int pos = 0;
+        while (pos < maskWordBits) {
+            // Look for the next set bit if we're outside a run, or the next
+            // clear bit if we're inside one
+            const MaskWord remaining = (open ? ~word : word) & (allOnes << pos);
+            if (remaining == 0) break;
+            pos = __builtin_ctzll(remaining);
+            if (open) {
+                Run run = { row, start, base + pos, 0 };
+                runs.push_back(run);
+            } else start = base + pos;
+            open = !open;
+        }
+    }
+    if (open) {
+        Run run = { row, start, width, 0 };
+        runs.push_back(run);
+    }
+}
+
+#endif /* end of include guard: MASK_HPP_W3N8QX1D */
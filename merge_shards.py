@@ -0,0 +1,98 @@
+#!/usr/bin/env python
+# encoding: utf-8
+# Jess Robertson, 2026-10-18
+#
+# Merges the dump files written by several ./process_images processes run
+# with --shard i/N back into a single frame-ordered dump file.
+
+import sys
+import getopt
+import heapq
+from frame_index import indexMagic, index_path, write_index_record
+
+# ==> Usage exception class and help message =================================
+
+help_message = \
+"""Usage: ./merge_shards.py [options] <shard_file> [<shard_file> ...]\n
+Options:
+\t--output=<file>  File to which merged records should be written.
+\t--help           Displays this message.
+"""
+class Usage(Exception):
+    def __init__(self, msg):
+        self.msg = msg
+
+
+
+# ==> Merging functions ======================================================
+
+def read_records(shardFile):
+    """ Generates (sequence, blob count, line) tuples from a shard dump file.
+
+        Each shard processes its files in sequence order, so the records in
+        a single shard file are already sorted.
+    """
+    for line in open(shardFile, 'r'):
+        if line[0] == '#' or not line.strip(): continue
+        record = eval(line)
+        yield (record['sequence'], len(record['centroids']), line)
+
+def merge_shards(shardFiles, outputFile):
+    """ Performs a k-way merge of the given shard files on the per-record
+        sequence keys, writing the merged records to outputFile along with
+        a frame index for the merged file.
+
+        Only one record per shard is held in memory at a time. Returns the
+        number of records written.
+    """
+    try:
+        nRecords = 0
+        output = open(outputFile, 'w')
+        index = open(index_path(outputFile), 'wb')
+        index.write(indexMagic)
+        streams = [read_records(f) for f in shardFiles]
+        for sequence, blobCount, line in heapq.merge(*streams):
+            write_index_record(index, output.tell(), sequence, blobCount)
+            output.write(line)
+            nRecords += 1
+        output.close()
+        index.close()
+        return nRecords
+    except IOError as e:
+        msg = "Exception encountered when attempting " + \
+              "to merge shard files.\n\t -- Exception was: {0}" + \
+              "\n\t For help use --help"
+        raise Usage(msg.format(e))
+
+
+# ==> Main routine ===========================================================
+
+def main(argv=None):
+    if argv is None:
+        argv = sys.argv
+    try:
+        try:
+            opts, args = getopt.getopt(argv[1:], "ho:", ["help", "output="])
+        except getopt.error as msg:
+            raise Usage(msg)
+
+        outputFile = 'merged.py'
+        for option, value in opts:
+            if option in ("-h", "--help"):
+                raise Usage(help_message)
+            if option in ("-o", "--output"):
+                outputFile = value
+        if len(args) == 0:
+            raise Usage("No shard files given!\n\t For help use --help")
+
+        nRecords = merge_shards(args, outputFile)
+        print("Merged {0} records from {1} shards into {2}".format(
+            nRecords, len(args), outputFile))
+
+    except Usage as e:
+        print(e.msg)
+        return 2
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,232 @@
+/*
+    strips.cpp (ImageAnalyst)
+    Jess Robertson, 2026-10-18
+    
+    Implementation of RowBlur and StripSegmenter methods
+*/
+
+#include "strips.hpp"
+
+// = RowBlur =
+RowBlur::RowBlur(int w, int h, int r): 
+    width(w), height(h), radius(std::max(r, 0)), rowsIn(0), rowsOut(0)
+{
+    kernel.resize(2*radius + 1);
+    for (int k = -radius; k <= radius; ++k)
+        kernel[k + radius] = exp(-0.5*k*k);
+    window.resize(std::size_t(2*radius + 1) * width);
+    column.resize(width);
+}
+int RowBlur::push_row(const float* input, float* output) {
+    std::copy(input, input + width, 
+        &window[std::size_t(rowsIn % (2*radius + 1)) * width]);
+    ++rowsIn;
+    if (rowsIn - 1 - radius < 0) return -1;
+    _blur(rowsOut, output);
+    return rowsOut++;
+}
+int RowBlur::flush_row(float* output) {
+    if (rowsOut >= height || rowsOut >= rowsIn) return -1;
+    _blur(rowsOut, output);
+    return rowsOut++;
+}
+void RowBlur::_blur(int y, float* output) {
+    // Vertical pass over the rows in the window
+    const int lo = std::max(y - radius, 0), 
+              hi = std::min(y + radius, rowsIn - 1);
+    float weight = 0;
+    std::fill(column.begin(), column.end(), 0.0f);
+    for (int yy = lo; yy <= hi; ++yy) {
+        const float w = kernel[yy - y + radius];
+        const float* row = &window[std::size_t(yy % (2*radius + 1)) * width];
+        for (int x = 0; x < width; ++x)
+            column[x] += w*row[x];
+        weight += w;
+    }
+    
+    // Horizontal pass
+    for (int x = 0; x < width; ++x) {
+        const int left = std::max(x - radius, 0), 
+                  right = std::min(x + radius, width - 1);
+        float sum = 0, rowWeight = 0;
+        for (int xx = left; xx <= right; ++xx) {
+            const float w = kernel[xx - x + radius];
+            sum += w*column[xx];
+            rowWeight += w;
+        }
+        output[x] = sum/(rowWeight*weight);
+    }
+}
+
+// = StripSegmenter =
+StripSegmenter* StripSegmenter::activeSegmenter = 0;
+
+// Ctor, dtor etc
+StripSegmenter::StripSegmenter(const AnalystSettings& s):
+    settings(s), nColumns(0), nRows(0), notSegmented(true), 
+    labeler(s.connectivity), rowsRead(0), 
+    logger(new Logger(localLoggingLevel))
+{
+    logger->message("Constructed strip segmenter instance", debugLevel);
+}
+StripSegmenter::~StripSegmenter() {
+    logger->message("Deleting strip segmenter instance", debugLevel);
+}
+
+/*  Segments an image without decoding all of it into memory. We ask 
+    GraphicsMagick to stream the image (ReadStream), which hands each 
+    region of pixels to _stream_rows as soon as it has been decoded and 
+    then discards it. Each row in the segmentation window then goes 
+    through the pipeline:
+    1. Convert to greyscale and blur on the blob size (RowBlur)
+    2. Threshold into a mask row (RowThresholder)
+    3. Label the mask row (StreamingLabeler), which writes out the 
+       statistics of each blob as soon as it is complete.
+    Centroids match ImageAnalyst::segment up to the differences between 
+    RowBlur and Magick's blur and greyscale quantization.
+    
+    The pipeline needs every row exactly once, from top to bottom. The 
+    stream handler isn't told where its pixels are in the image, so we 
+    only accept formats whose decoders write whole rows top to bottom 
+    (see streams_in_order), and check that every region is a whole row 
+    and that we get each row once. Otherwise UnsupportedStream is thrown, 
+    and the caller can segment the whole image instead.
+*/
+void StripSegmenter::segment(const bfs::path& fileLocation) {
+    std::ostringstream msg;
+    msg << "Streaming " << fileLocation << " in strips";
+    logger->message(msg.str(), debugLevel);
+    
+    // Only one segmenter can be streaming at a time
+    activeSegmenter = this;
+    streamError.clear();
+    MagickLib::ExceptionInfo exception;
+    MagickLib::GetExceptionInfo(&exception);
+    MagickLib::ImageInfo* imageInfo = MagickLib::CloneImageInfo(0);
+    strncpy(imageInfo->filename, fileLocation.string().c_str(), 
+        MaxTextExtent - 1);
+    MagickLib::Image* image = \
+        MagickLib::ReadStream(imageInfo, &_stream_rows, &exception);
+    if (image) MagickLib::DestroyImage(image);
+    MagickLib::DestroyImageInfo(imageInfo);
+    activeSegmenter = 0;
+    
+    // Our own errors come first, since stopping the stream can make the 
+    // decoder report one as well
+    if (streamError.empty() && rowsRead != int(nRows) 
+        && exception.severity == MagickLib::UndefinedException)
+        streamError = "decoder didn't stream every row";
+    if (not(streamError.empty())) {
+        MagickLib::DestroyExceptionInfo(&exception);
+        throw UnsupportedStream(fileLocation, streamError);
+    }
+    try {
+        Magick::throwException(exception);
+    } catch(...) {
+        MagickLib::DestroyExceptionInfo(&exception);
+        throw;
+    }
+    MagickLib::DestroyExceptionInfo(&exception);
+    
+    _finish();
+    notSegmented = false;
+}
+
+/*  streams_in_order
+    Whether GraphicsMagick's decoder for a format writes each row of the 
+    image once, top to bottom. Formats not listed here may write tiles, 
+    several interlaced passes or rows from the bottom up (e.g. BMP).
+*/
+static bool streams_in_order(const char* magick) {
+    static const char* formats[] = {"JPEG", "JPG", "PNG", "PNM", "PBM", 
+        "PGM", "PPM", "PAM", "TIFF", "TIF", "GRAY", "RGB"};
+    for (std::size_t f = 0; f < sizeof(formats)/sizeof(formats[0]); ++f)
+        if (strcmp(magick, formats[f]) == 0) return true;
+    return false;
+}
+
+/*  Decoder callback. Exceptions can't be thrown through the decoder, so 
+    problems are noted in streamError and we return false to stop the 
+    stream.
+*/
+unsigned int StripSegmenter::_stream_rows(const MagickLib::Image* image,
+    const void* pixels, const size_t columns)
+{
+    StripSegmenter* segmenter = activeSegmenter;
+    if (segmenter->rowsRead == 0) {
+        if (not(streams_in_order(image->magick))) {
+            segmenter->streamError = std::string(image->magick) 
+                + " images can't be streamed by rows";
+            return false;
+        }
+        segmenter->_start(image->columns, image->rows);
+    }
+    if (columns != segmenter->nColumns) {
+        segmenter->streamError = "decoder streamed part of a row";
+        return false;
+    }
+    if (segmenter->rowsRead >= int(segmenter->nRows)) {
+        segmenter->streamError = "decoder streamed too many rows";
+        return false;
+    }
+    segmenter->_push_pixels(static_cast<const Magick::PixelPacket*>(pixels));
+    return true;
+}
+
+// Set up window and pipeline once the image size is known
+void StripSegmenter::_start(unsigned int columns, unsigned int rows) {
+    nColumns = columns;
+    nRows = rows;
+    iMin = std::max(settings.segmentWindow(0), 0);
+    iMax = std::min(settings.segmentWindow(1), int(columns));
+    jMin = std::max(settings.segmentWindow(2), 0);
+    jMax = std::min(settings.segmentWindow(3), int(rows)); 
+    if (iMax < 0) iMax = int(columns);
+    if (jMax < 0) jMax = int(rows);
+    
+    const int width = iMax - iMin, height = jMax - jMin;
+    blur.reset(new RowBlur(width, height, settings.blobSize));
+    thresholder.reset(new RowThresholder(width, height, 
+        settings.thresholdMode, settings.thresholdWindow*settings.blobSize, 
+        settings.thresholdFraction, settings.sauvolaK, MaxRGB));
+    gray.resize(width);
+    blurred.resize(width);
+    maskRow.resize((width + maskWordBits - 1)/maskWordBits);
+}
+void StripSegmenter::_push_pixels(const Magick::PixelPacket* pixels) {
+    const int j = rowsRead++;
+    if (j < jMin || j >= jMax) return;
+    for (int i = iMin; i < iMax; ++i)
+        gray[i - iMin] = 0.299f*pixels[i].red + 0.587f*pixels[i].green 
+                         + 0.114f*pixels[i].blue;
+    if (blur->push_row(&gray[0], &blurred[0]) >= 0) _push_blurred();
+}
+void StripSegmenter::_push_blurred() {
+    std::fill(maskRow.begin(), maskRow.end(), MaskWord(0));
+    if (thresholder->push_row(&blurred[0], &maskRow[0]) >= 0)
+        labeler.push_row(&maskRow[0], iMax - iMin);
+}
+void StripSegmenter::_finish() {
+    // Drain the rows still held back by the blur and threshold windows
+    if (blur.get()) {
+        while (blur->flush_row(&blurred[0]) >= 0) _push_blurred();
+        std::fill(maskRow.begin(), maskRow.end(), MaskWord(0));
+        while (thresholder->flush_row(&maskRow[0]) >= 0) {
+            labeler.push_row(&maskRow[0], iMax - iMin);
+            std::fill(maskRow.begin(), maskRow.end(), MaskWord(0));
+        }
+    }
+    labeler.finish();
+    
+    std::ostringstream msg;
+    msg << "Found " << labeler.get_blobs().size() << " blobs";
+    logger->message(msg.str(), debugLevel);
+}
+
+// = Accessor methods for blob data =
+void StripSegmenter::get_centroids(std::vector<Index>& centroids) {
+    if (notSegmented) throw ImageNotSegmented();
+    foreach(const BlobStats& blob, labeler.get_blobs())
+        centroids.push_back(Index(iMin + int(blob.sumI/blob.area), 
+                                  jMin + int(blob.sumJ/blob.area)));
+}
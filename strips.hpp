@@ -0,0 +1,113 @@
+/*
+    strips.hpp (ImageAnalyst)
+    Jess Robertson, 2026-10-18
+    
+    Out-of-core segmentation for images which are too large to decode into 
+    memory. Rows are streamed out of the decoder one at a time and passed 
+    through a pipeline of row-at-a-time stages (blur, threshold and label), 
+    each of which only keeps the strip of rows its window needs. Peak 
+    memory is therefore O(width x strip height + open blobs) whatever the 
+    height of the image.
+*/
+
+#ifndef STRIPS_HPP_Q2X8BM6V
+#define STRIPS_HPP_Q2X8BM6V
+
+#include "common.hpp"
+#include "types.hpp"
+#include "logger.hpp"
+#include "analyst.hpp"
+#include "threshold.hpp"
+#include "labeler.hpp"
+
+/*  = Row blur =
+    Gaussian blur (with unit sigma, as Magick::Image::blur uses by default) 
+    applied separably to rows as they arrive. Like RowThresholder, output 
+    rows lag the input by the blur radius and the last rows come out of 
+    flush_row. Near the edges the kernel is truncated and renormalised.
+*/
+class RowBlur {
+public:
+    RowBlur(int width, int height, int radius);
+    
+    // Push the next row, writing the next blurred row into output and 
+    // returning its index if one is ready, or -1 otherwise
+    int push_row(const float* input, float* output);
+    
+    // Blur the next remaining row after all rows have been pushed, 
+    // returning its index or -1 if all rows are done
+    int flush_row(float* output);
+    
+private:
+    int width, height, radius;
+    int rowsIn, rowsOut;
+    std::vector<float> kernel, window, column;
+    
+    void _blur(int y, float* output);
+};
+
+// = Class interface =
+class StripSegmenter {
+public:
+    StripSegmenter(const AnalystSettings& settings);
+    virtual ~StripSegmenter();
+    
+    // Analysis methods
+    void segment(const bfs::path& fileLocation);
+    
+    // Accessor methods - must call segment first, and match ImageAnalyst
+    void get_centroids(std::vector<Index>& centroids);
+    inline unsigned int columns() { return nColumns; }
+    inline unsigned int rows() { return nRows; }
+    inline blitz::TinyVector<int, 4> get_window_size() {
+        blitz::TinyVector<int, 4> result(iMin, iMax, jMin, jMax);
+        return result;
+    };
+    
+private:
+    // Data
+    AnalystSettings settings;
+    unsigned int nColumns, nRows;
+    int iMin, iMax, jMin, jMax;
+    bool notSegmented;
+    
+    // Pipeline stages and their row buffers
+    std::auto_ptr<RowBlur> blur;
+    std::auto_ptr<RowThresholder> thresholder;
+    StreamingLabeler labeler;
+    std::vector<float> gray, blurred;
+    std::vector<MaskWord> maskRow;
+    int rowsRead;
+    std::string streamError; // why the stream was stopped, if it was
+    
+    // Pipeline methods
+    void _start(unsigned int columns, unsigned int rows);
+    void _push_pixels(const Magick::PixelPacket* pixels);
+    void _push_blurred();
+    void _finish();
+    
+    // Decoder callback, which passes rows to the active segmenter
+    static unsigned int _stream_rows(const MagickLib::Image* image,
+        const void* pixels, const size_t columns);
+    static StripSegmenter* activeSegmenter;
+    
+	// Logging
+	const static LogLevel localLoggingLevel = traceLevel;   
+	std::auto_ptr<Logger> logger;   
+};
+
+// = Exceptions =
+class UnsupportedStream: public std::exception {
+public:
+    UnsupportedStream(const bfs::path& p, const std::string& reason) { 
+        std::ostringstream msg;
+        msg << "Unable to stream " << p << " in strips: " << reason;
+        _msg = msg.str();
+    } 
+    virtual ~UnsupportedStream() throw() { /* pass */ }
+    virtual const char* what() const throw() { return _msg.c_str(); }
+private:
+    std::string _msg;
+};
+
+#endif /* end of include guard: STRIPS_HPP_Q2X8BM6V */
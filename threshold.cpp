@@ -0,0 +1,103 @@
+/*
+    threshold.cpp (ImageAnalyst)
+    Jess Robertson, 2026-10-18
+
+    Implementation of RowThresholder methods
+*/
+
+#include "threshold.hpp"
+
+// Ctor - a global threshold doesn't need a window
+RowThresholder::RowThresholder(int w, int h, ThresholdMode m, int r,
+    double f, double kValue, double maxV):
+    width(w), height(h), radius(m == globalThreshold ? 0 : std::max(r, 0)),
+    mode(m), fraction(f), k(kValue), maxValue(maxV), rowsIn(0), rowsOut(0)
+{
+    window.resize(std::size_t(2*radius + 1) * width);
+    if (mode != globalThreshold) {
+        columnSums.assign(width, 0.0);
+        prefixSums.resize(width + 1);
+        if (mode == sauvolaThreshold) {
+            columnSquares.assign(width, 0.0);
+            prefixSquares.resize(width + 1);
+        }
+    }
+}
+
+int RowThresholder::push_row(const float* gray, MaskWord* bits) {
+    // Remove the row leaving the window before its slot is reused
+    const int leaving = rowsIn - (2*radius + 1);
+    if (leaving >= 0) _update_columns(leaving, -1.0);
+    std::copy(gray, gray + width, _window_row(rowsIn));
+    _update_columns(rowsIn, 1.0);
+    ++rowsIn;
+
+    // Row y is ready once rows up to y + radius are in the window
+    if (rowsIn - 1 - radius < 0) return -1;
+    _threshold(rowsOut, bits);
+    return rowsOut++;
+}
+int RowThresholder::flush_row(MaskWord* bits) {
+    if (rowsOut >= height || rowsOut >= rowsIn) return -1;
+
+    // No more rows enter, but the row above the window still leaves
+    const int leaving = rowsOut - radius - 1;
+    if (leaving >= 0) _update_columns(leaving, -1.0);
+    _threshold(rowsOut, bits);
+    return rowsOut++;
+}
+
+// Add (sign = 1) or remove (sign = -1) a window row from the column sums
+void RowThresholder::_update_columns(int y, double sign) {
+    if (mode == globalThreshold) return;
+    const float* row = _window_row(y);
+    for (int x = 0; x < width; ++x)
+        columnSums[x] += sign*row[x];
+    if (mode == sauvolaThreshold)
+        for (int x = 0; x < width; ++x)
+            columnSquares[x] += sign*row[x]*row[x];
+}
+
+// Threshold row y into bits, setting bits for foreground (dark) pixels
+void RowThresholder::_threshold(int y, MaskWord* bits) {
+    const float* row = _window_row(y);
+    if (mode == globalThreshold) {
+        const float level = fraction*maxValue;
+        for (int x = 0; x < width; ++x)
+            bits[x / maskWordBits] |=
+                MaskWord(row[x] <= level) << (x % maskWordBits);
+        return;
+    }
+
+    // Take prefix sums of the column sums along the row
+    prefixSums[0] = 0;
+    for (int x = 0; x < width; ++x)
+        prefixSums[x+1] = prefixSums[x] + columnSums[x];
+    if (mode == sauvolaThreshold) {
+        prefixSquares[0] = 0;
+        for (int x = 0; x < width; ++x)
+            prefixSquares[x+1] = prefixSquares[x] + columnSquares[x];
+    }
+
+    // Window is clipped to the image, so count the rows actually in it
+    const int nRows = std::min(y + radius, height - 1)
+                      - std::max(y - radius, 0) + 1;
+    const double range = 0.5*maxValue; // dynamic range of the std dev
+    for (int x = 0; x < width; ++x) {
+        const int lo = std::max(x - radius, 0),
+                  hi = std::min(x + radius, width - 1) + 1;
+        const double count = double(nRows)*(hi - lo);
+        const double mean = (prefixSums[hi] - prefixSums[lo])/count;
+        double level;
+        if (mode == meanThreshold)
+            level = fraction*mean;
+        else {
+            const double meanSquare = \
+                (prefixSquares[hi] - prefixSquares[lo])/count;
+            const double stddev = sqrt(std::max(meanSquare - mean*mean, 0.0));
+            level = mean*(1 + k*(stddev/range - 1));
+        }
+        bits[x / maskWordBits] |=
+            MaskWord(row[x] <= level) << (x % maskWordBits);
+    }
+}
@@ -0,0 +1,74 @@
+/*
+    threshold.hpp (ImageAnalyst)
+    Jess Robertson, 2026-10-18
+
+    Row-at-a-time thresholding of greyscale images into a BinaryMask. As
+    well as a single global threshold this supports local adaptive
+    thresholds (mean or Sauvola) over a square window, which handle
+    unevenly lit frames.
+*/
+
+#ifndef THRESHOLD_HPP_H8D2LQ0R
+#define THRESHOLD_HPP_H8D2LQ0R
+
+#include "common.hpp"
+#include "mask.hpp"
+
+// Thresholding modes - in all of them dark pixels are the foreground
+enum ThresholdMode {
+    globalThreshold,  // gray <= fraction*maxValue
+    meanThreshold,    // gray <= fraction*(local mean)
+    sauvolaThreshold  // gray <= mean*(1 + k*(stddev/(maxValue/2) - 1))
+};
+
+/*  = Class interface =
+    Rows of greyscale values are pushed in order with push_row, and the
+    thresholded rows come out radius rows later, once the window below
+    them has been seen. Rows always come out in order, so the caller can
+    pass the destination for its next expected output row. Call flush_row
+    after the last input row until it returns -1 to get the remaining
+    rows.
+
+    Local statistics come from a summed-area table which is built
+    incrementally: we keep the sum (and sum of squares) of each column
+    over the rows in the window, adding the entering row and removing
+    the leaving one, and take prefix sums along the row of these column
+    sums. Any window sum is then the difference of two prefix sums, so
+    each pixel costs O(1) whatever the window size, and only the 2r+1
+    rows in the window are kept in memory.
+*/
+class RowThresholder {
+public:
+    RowThresholder(int width, int height, ThresholdMode mode, int radius,
+        double fraction, double k, double maxValue);
+
+    // Push the next row of gray values. If a row is ready it's written
+    // into bits, which must be zeroed, and its index is returned.
+    // Otherwise returns -1.
+    int push_row(const float* gray, MaskWord* bits);
+
+    // Threshold the next remaining row after all rows have been pushed,
+    // returning its index or -1 if all rows are done
+    int flush_row(MaskWord* bits);
+
+private:
+    // Settings
+    int width, height, radius;
+    ThresholdMode mode;
+    double fraction, k, maxValue;
+
+    // Window data
+    int rowsIn, rowsOut;
+    std::vector<float> window; // ring buffer of 2r+1 rows
+    std::vector<double> columnSums, columnSquares;
+    std::vector<double> prefixSums, prefixSquares;
+
+    // Helpers
+    inline float* _window_row(int y) {
+        return &window[std::size_t(y % (2*radius + 1)) * width];
+    }
+    void _update_columns(int y, double sign);
+    void _threshold(int y, MaskWord* bits);
+};
+
+#endif /* end of include guard: THRESHOLD_HPP_H8D2LQ0R */
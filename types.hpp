@@ -12,5 +12,6 @@
 
 typedef blitz::TinyVector<int, 2> Index;
 typedef int Label;
+typedef blitz::TinyVector<int, 4> Box; // (iMin, iMax, jMin, jMax)
 
 #endif /* end of include guard: TYPES_HPP_LRA6JOKU */
@@ -29,31 +29,5 @@ inline std::string to_string(Iterator inputBegin, Iterator inputEnd) {
     streamOut << std::endl;
     return streamOut.str();
 }
-  
-/* do_sets_intersect 
-   Template determines whether the supplied ordered containers have a 
-   (non-empty) intersection. Algorithm uses the fact that sets must be 
-   ordered. This loops through the two sets using iterators and at each step 
-   it compares the values.       
-    -- If the iterator values are the same then we are done.
-    -- If either iterator is larger than the other then increment the 
-       iterator with the smaller value, since the ordering means the smaller 
-       iterator value cannot be in the set.                                           
-   If no intersection is found (i.e. when one of the sequences terminates) 
-   this function will return false. 
-*/ 
-template <class IterA, class IterB>                               
-bool do_sets_intersect(IterA A, IterA endA, IterB B, IterB endB) { 
-    bool intersectQ = false;
-    while ((A != endA) && (B != endB)) {
-        if (*A<*B) ++A; 
-        else if (*B<*A) ++B;
-        else { intersectQ = true; break; }
-    }  
-    return intersectQ;
-} 
-
-void insert_and_merge(std::set<Label>& newSet, 
-    std::list< std::set<Label> >& listOfSets);
 
 #endif /* end of include guard: UTILITIES_HPP_2S3C0BGX */
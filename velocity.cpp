@@ -0,0 +1,242 @@
+/*
+    velocity.cpp (ImageAnalyst)
+    Jess Robertson, 2026-10-18
+    
+    Implementation of VelocityField methods
+*/
+
+#include "velocity.hpp"
+#include <netcdfcpp.h>
+
+// Ctor, dtor etc
+VelocityField::VelocityField(const VelocitySettings& s): 
+    settings(s), logger(new Logger(localLoggingLevel))
+{
+    _allocate();
+    logger->message("Constructed velocity field instance", debugLevel);
+}
+VelocityField::VelocityField(const bfs::path& fieldFile): 
+    logger(new Logger(localLoggingLevel))
+{
+    // Read grid and parameters back from the file attributes
+    NcError errorMode(NcError::silent_nonfatal);
+    NcFile file(fieldFile.string().c_str(), NcFile::ReadOnly);
+    NcDim *xDim = file.get_dim("x"), *yDim = file.get_dim("y");
+    NcAtt *frames = file.get_att("n_frames"), 
+          *secondsPerFrame = file.get_att("seconds_per_frame"),
+          *millimetersPerPixel = file.get_att("millimeters_per_pixel"),
+          *extent = file.get_att("extent");
+    bool valid = file.is_valid() && xDim && yDim && frames 
+        && secondsPerFrame && millimetersPerPixel && extent;
+    if (valid) {
+        settings.nBinsX = xDim->size();
+        settings.nBinsY = yDim->size();
+        settings.nFrames = frames->as_int(0);
+        settings.secondsPerFrame = secondsPerFrame->as_double(0);
+        settings.millimetersPerPixel = millimetersPerPixel->as_double(0);
+        for (int i = 0; i < 4; ++i)
+            settings.extent[i] = extent->as_int(i);
+        valid = settings.nFrames >= 1 && settings.secondsPerFrame > 0 
+            && settings.millimetersPerPixel > 0;
+    }
+    delete frames;
+    delete secondsPerFrame;
+    delete millimetersPerPixel;
+    delete extent;
+    if (not(valid)) throw InvalidFieldFile(fieldFile);
+    
+    // Read accumulators - the file stores variances, so convert back to 
+    // sums of squared deviations
+    _allocate();
+    const char* names[] = {"count", "mean_u", "mean_v", "var_u", "var_v"};
+    blitz::Array<double, 2>* arrays[] = {&count, &meanU, &meanV, &m2U, &m2V};
+    for (int i = 0; i < 5; ++i) {
+        NcVar* var = file.get_var(names[i]);
+        if (not(var && var->get(arrays[i]->data(), 
+                                settings.nBinsY, settings.nBinsX)))
+            throw InvalidFieldFile(fieldFile);
+    }
+    for (int j = 0; j < settings.nBinsY; ++j)
+        for (int i = 0; i < settings.nBinsX; ++i) {
+            m2U(j, i) *= count(j, i);
+            m2V(j, i) *= count(j, i);
+        }
+    logger->message("Loaded velocity field instance", debugLevel);
+}
+VelocityField::~VelocityField() {
+    logger->message("Destructing velocity field instance", debugLevel);
+}
+void VelocityField::_allocate() {
+    count.resize(settings.nBinsY, settings.nBinsX);
+    meanU.resize(settings.nBinsY, settings.nBinsX);
+    meanV.resize(settings.nBinsY, settings.nBinsX);
+    m2U.resize(settings.nBinsY, settings.nBinsX);
+    m2V.resize(settings.nBinsY, settings.nBinsX);
+    count = 0;
+    meanU = 0;
+    meanV = 0;
+    m2U = 0;
+    m2V = 0;
+}
+
+/*  Adds the velocities along a trail to the grid. Velocities are finite 
+    differences between points nFrames apart in the trail, in mm/s, and 
+    are binned by the earlier point. Each cell's mean and sum of squared 
+    deviations are updated with Welford's algorithm, which is stable for 
+    any number of samples.
+*/
+void VelocityField::add_trail(const std::vector<Index>& trail) {
+    const double dt = settings.nFrames*settings.secondsPerFrame;
+    const double scale = settings.millimetersPerPixel/dt;
+    const double xBinsPerPixel = \
+        settings.nBinsX/double(settings.extent[1] - settings.extent[0]);
+    const double yBinsPerPixel = \
+        settings.nBinsY/double(settings.extent[3] - settings.extent[2]);
+    for (int k = 0; k + settings.nFrames < int(trail.size()); ++k) {
+        const Index& start = trail[k];
+        const Index& end = trail[k + settings.nFrames];
+        const int i = int(floor((start[0] - settings.extent[0])*xBinsPerPixel)),
+                  j = int(floor((start[1] - settings.extent[2])*yBinsPerPixel));
+        if (i < 0 || i >= settings.nBinsX || j < 0 || j >= settings.nBinsY) 
+            continue;
+        
+        const double u = (end[0] - start[0])*scale, 
+                     v = (end[1] - start[1])*scale;
+        const double n = (count(j, i) += 1);
+        const double du = u - meanU(j, i), dv = v - meanV(j, i);
+        meanU(j, i) += du/n;
+        meanV(j, i) += dv/n;
+        m2U(j, i) += du*(u - meanU(j, i));
+        m2V(j, i) += dv*(v - meanV(j, i));
+    }
+}
+void VelocityField::add_trails(const bfs::path& trailFile) {
+    std::ifstream stream(trailFile.string().c_str());
+    if (not(stream.is_open())) throw InvalidTrailFile(trailFile);
+    std::vector<Index> trail;
+    std::size_t nTrails = 0;
+    while (read_trail(stream, trail)) {
+        add_trail(trail);
+        ++nTrails;
+    }
+    
+    std::ostringstream msg;
+    msg << "Added " << nTrails << " trails from " << trailFile;
+    logger->message(msg.str(), traceLevel);
+}
+
+/*  Merges another field's samples into this one, cell by cell, using 
+    Chan et al's pairwise update for the mean and squared deviations. The 
+    result is the same as accumulating both sets of trails together.
+*/
+void VelocityField::merge(const VelocityField& other) {
+    const VelocitySettings& s = other.settings;
+    bool sameExtent = true;
+    for (int i = 0; i < 4; ++i) 
+        sameExtent = sameExtent && (s.extent[i] == settings.extent[i]);
+    if (not(sameExtent) || s.nBinsX != settings.nBinsX 
+        || s.nBinsY != settings.nBinsY || s.nFrames != settings.nFrames
+        || s.secondsPerFrame != settings.secondsPerFrame 
+        || s.millimetersPerPixel != settings.millimetersPerPixel)
+        throw IncompatibleFields();
+    
+    for (int j = 0; j < settings.nBinsY; ++j)
+        for (int i = 0; i < settings.nBinsX; ++i) {
+            const double nA = count(j, i), nB = other.count(j, i);
+            if (nB == 0) continue;
+            const double n = nA + nB;
+            const double du = other.meanU(j, i) - meanU(j, i), 
+                         dv = other.meanV(j, i) - meanV(j, i);
+            meanU(j, i) += du*nB/n;
+            meanV(j, i) += dv*nB/n;
+            m2U(j, i) += other.m2U(j, i) + du*du*nA*nB/n;
+            m2V(j, i) += other.m2V(j, i) + dv*dv*nA*nB/n;
+            count(j, i) = n;
+        }
+}
+
+/*  Writes the field to a NetCDF file with variables count, mean_u, mean_v, 
+    var_u and var_v on a (y, x) grid, along with the bin centres in mm and 
+    the parameters as global attributes. Variances are population 
+    variances (zero for empty cells), so the file can be loaded and merged 
+    again without losing anything.
+*/
+void VelocityField::write(const bfs::path& fieldFile) {
+    NcError errorMode(NcError::silent_nonfatal);
+    NcFile file(fieldFile.string().c_str(), NcFile::Replace);
+    if (not(file.is_valid())) throw InvalidFieldFile(fieldFile);
+    const int nx = settings.nBinsX, ny = settings.nBinsY;
+    
+    // Parameters
+    file.add_att("n_frames", settings.nFrames);
+    file.add_att("seconds_per_frame", settings.secondsPerFrame);
+    file.add_att("millimeters_per_pixel", settings.millimetersPerPixel);
+    const int extent[4] = {settings.extent[0], settings.extent[1], 
+                           settings.extent[2], settings.extent[3]};
+    file.add_att("extent", 4, extent);
+    
+    // Bin centres
+    NcDim *yDim = file.add_dim("y", ny), *xDim = file.add_dim("x", nx);
+    std::vector<double> xs(nx), ys(ny);
+    const double xWidth = (settings.extent[1] - settings.extent[0])/double(nx),
+                 yWidth = (settings.extent[3] - settings.extent[2])/double(ny);
+    for (int i = 0; i < nx; ++i) 
+        xs[i] = (settings.extent[0] + (i + 0.5)*xWidth)
+                *settings.millimetersPerPixel;
+    for (int j = 0; j < ny; ++j) 
+        ys[j] = (settings.extent[2] + (j + 0.5)*yWidth)
+                *settings.millimetersPerPixel;
+    NcVar *xVar = file.add_var("x", ncDouble, xDim),
+          *yVar = file.add_var("y", ncDouble, yDim);
+    xVar->add_att("units", "mm");
+    yVar->add_att("units", "mm");
+    xVar->put(&xs[0], nx);
+    yVar->put(&ys[0], ny);
+    
+    // Accumulators
+    blitz::Array<double, 2> varU(ny, nx), varV(ny, nx);
+    for (int j = 0; j < ny; ++j)
+        for (int i = 0; i < nx; ++i) {
+            const double n = count(j, i);
+            varU(j, i) = (n > 0) ? m2U(j, i)/n : 0;
+            varV(j, i) = (n > 0) ? m2V(j, i)/n : 0;
+        }
+    const char* names[] = {"count", "mean_u", "mean_v", "var_u", "var_v"};
+    const char* units[] = {"1", "mm/s", "mm/s", "mm2/s2", "mm2/s2"};
+    blitz::Array<double, 2>* arrays[] = \
+        {&count, &meanU, &meanV, &varU, &varV};
+    for (int i = 0; i < 5; ++i) {
+        NcVar* var = file.add_var(names[i], ncDouble, yDim, xDim);
+        if (not(var)) throw InvalidFieldFile(fieldFile);
+        var->add_att("units", units[i]);
+        if (not(var->put(arrays[i]->data(), ny, nx))) 
+            throw InvalidFieldFile(fieldFile);
+    }
+    
+    std::ostringstream msg;
+    msg << "Wrote velocity field with " << get_sample_count() 
+        << " samples to " << fieldFile;
+    logger->message(msg.str(), traceLevel);
+}
+
+// = Trail file reader =
+/*  Trail files have one trail per line, written as a Python list of 
+    tuples, e.g. "[(12, 40), (10, 41), ]". We just pull the integers out 
+    of each line in order and pair them up.
+*/
+bool read_trail(std::istream& stream, std::vector<Index>& trail) {
+    std::string line;
+    while (std::getline(stream, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        for (std::size_t i = 0; i < line.size(); ++i)
+            if (not(isdigit(line[i]) || line[i] == '-')) line[i] = ' ';
+        
+        std::istringstream values(line);
+        trail.clear();
+        int x, y;
+        while (values >> x >> y)
+            trail.push_back(Index(x, y));
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,98 @@
+/*
+    velocity.hpp (ImageAnalyst)
+    Jess Robertson, 2026-10-18
+    
+    Streaming accumulation of blob velocities onto a fixed grid. Trails 
+    are turned into finite-difference velocities over nFrames frames 
+    (as in PositionPlotter in extract_movements.py) and binned by their 
+    starting position, keeping the count, mean and variance of each 
+    velocity component in each cell. Memory depends only on the grid 
+    size, and fields from separate runs or shards can be merged.
+*/
+
+#ifndef VELOCITY_HPP_R7C2NW5P
+#define VELOCITY_HPP_R7C2NW5P
+
+#include "common.hpp"
+#include "types.hpp"
+#include "logger.hpp"
+
+// = Settings struct =
+typedef struct {
+    int nFrames;                // frames to calculate velocity over (>= 1)
+    double secondsPerFrame;
+    double millimetersPerPixel;
+    Box extent;                 // gridded region in pixels
+    int nBinsX, nBinsY;
+} VelocitySettings;
+
+// = Class interface =
+class VelocityField {
+public:
+    VelocityField(const VelocitySettings& settings);
+    VelocityField(const bfs::path& fieldFile); // load a saved field
+    virtual ~VelocityField();
+    
+    // Accumulation
+    void add_trail(const std::vector<Index>& trail);
+    void add_trails(const bfs::path& trailFile);
+    void merge(const VelocityField& other);
+    
+    // Output
+    void write(const bfs::path& fieldFile);
+    inline double get_sample_count() { return blitz::sum(count); }
+    
+private:
+    VelocitySettings settings;
+    
+    // Per cell accumulators, indexed by (y bin, x bin). m2 is the sum of 
+    // squared deviations from the mean, as in Welford's algorithm.
+    blitz::Array<double, 2> count, meanU, meanV, m2U, m2V;
+    
+    // Private methods
+    void _allocate();
+    
+	// Logging
+	const static LogLevel localLoggingLevel = traceLevel;   
+	std::auto_ptr<Logger> logger;   
+};
+
+// Read the next trail from a trail file written by PositionAnalyser.write,
+// returning false at the end of the file
+bool read_trail(std::istream& stream, std::vector<Index>& trail);
+
+// = Exceptions =
+class IncompatibleFields: public std::exception {
+public:
+    virtual const char* what() const throw() { 
+        return "Velocity fields must have the same grid and parameters "
+               "to be merged";
+    }
+};
+class InvalidFieldFile: public std::exception {
+public:
+    InvalidFieldFile(const bfs::path& p) { 
+        std::ostringstream msg;
+        msg << "Unable to read or write velocity field file " << p;
+        _msg = msg.str();
+    } 
+    virtual ~InvalidFieldFile() throw() { /* pass */ }
+    virtual const char* what() const throw() { return _msg.c_str(); }
+private:
+    std::string _msg;
+};
+
+class InvalidTrailFile: public std::exception {
+public:
+    InvalidTrailFile(const bfs::path& p) { 
+        std::ostringstream msg;
+        msg << "Unable to read trail file " << p;
+        _msg = msg.str();
+    } 
+    virtual ~InvalidTrailFile() throw() { /* pass */ }
+    virtual const char* what() const throw() { return _msg.c_str(); }
+private:
+    std::string _msg;
+};
+
+#endif /* end of include guard: VELOCITY_HPP_R7C2NW5P */
@@ -0,0 +1,169 @@
+/*
+    watcher.cpp (ImageAnalyst)
+    Jess Robertson, 2026-10-18
+    
+    Implementation of DirectoryWatcher methods
+*/
+
+#include "watcher.hpp"
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+
+// Set by the signal handler to stop the event loop
+static volatile sig_atomic_t stopWatching = 0;
+static void stop_watching(int) { stopWatching = 1; }
+
+/*  Files are picked up when they are closed after writing, or renamed 
+    into a watched directory, so partially written frames are retried 
+    once they are complete. New subdirectories are watched too if 
+    crawling recursively.
+*/
+static const boost::uint32_t fileEvents = IN_CLOSE_WRITE | IN_MOVED_TO;
+static const boost::uint32_t directoryEvents = IN_CREATE | IN_MOVED_TO;
+
+// Ctor, dtor etc
+DirectoryWatcher::DirectoryWatcher(Crawler& c, bool r):
+    crawler(c), recursive(r), logger(new Logger(localLoggingLevel))
+{
+    inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotifyFd < 0) throw WatchError("inotify_init1 failed", errno);
+    logger->message("Constructed watcher instance", debugLevel);
+}
+DirectoryWatcher::~DirectoryWatcher() {
+    close(inotifyFd);
+    logger->message("Destructing watcher instance", debugLevel);
+}
+
+void DirectoryWatcher::add(const bfs::path& directory) {
+    if (not(bfs::is_directory(directory))) {
+        std::ostringstream msg;
+        msg << "Not watching " << directory << " since it isn't a directory";
+        logger->message(msg.str(), warningLevel);
+        return;
+    }
+    _add_watch(directory);
+}
+void DirectoryWatcher::_add_watch(const bfs::path& directory) {
+    boost::uint32_t events = fileEvents | IN_DELETE_SELF;
+    if (recursive) events |= directoryEvents;
+    const int wd = inotify_add_watch(inotifyFd, directory.string().c_str(), 
+        events);
+    if (wd < 0) throw WatchError(directory.string(), errno);
+    directories[wd] = directory;
+    
+    std::ostringstream msg;
+    msg << "Watching " << directory;
+    logger->message(msg.str(), traceLevel);
+    
+    // Watch existing subdirectories as well
+    if (recursive)
+        for(bfs::directory_iterator it(directory), end; it != end; it++)
+            if (bfs::is_directory(it->path())) 
+                _add_watch(it->path());
+}
+
+// Event loop
+void DirectoryWatcher::run() {
+    stopWatching = 0;
+    signal(SIGINT, stop_watching);
+    signal(SIGTERM, stop_watching);
+    logger->message("Waiting for new files (interrupt to stop)", traceLevel);
+    
+    // Wake up periodically to check for a stop signal; events themselves 
+    // wake us immediately
+    const int pollTimeout = 250; // ms
+    std::vector<char> buffer(64*(sizeof(inotify_event) + NAME_MAX + 1));
+    pollfd descriptor = { inotifyFd, POLLIN, 0 };
+    while (!stopWatching && !directories.empty()) {
+        const int ready = poll(&descriptor, 1, pollTimeout);
+        if (ready < 0 && errno != EINTR) throw WatchError("poll failed", errno);
+        if (ready <= 0) continue;
+        
+        ssize_t length;
+        while ((length = read(inotifyFd, &buffer[0], buffer.size())) > 0)
+            _handle_events(&buffer[0], length);
+        if (length < 0 && errno != EAGAIN && errno != EINTR) 
+            throw WatchError("read failed", errno);
+    }
+    
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    logger->message("Stopped watching", traceLevel);
+}
+void DirectoryWatcher::_handle_events(const char* buffer, std::size_t length) {
+    std::size_t offset = 0;
+    while (offset < length) {
+        const inotify_event* event = \
+            reinterpret_cast<const inotify_event*>(buffer + offset);
+        offset += sizeof(inotify_event) + event->len;
+        
+        // Watched directory has gone away
+        if (event->mask & IN_IGNORED) {
+            directories.erase(event->wd);
+            continue;
+        }
+        if (event->len == 0 || directories.count(event->wd) == 0) continue;
+        const bfs::path path = directories[event->wd] / event->name;
+        
+        if (event->mask & IN_ISDIR) {
+            if (recursive && (event->mask & directoryEvents)) 
+                _add_directory(path);
+        } else if (event->mask & fileEvents)
+            _add_file(path);
+    }
+}
+
+/*  Watch a new subdirectory, then pick up any files which were written 
+    before the watch was added. The directory may already have been 
+    removed or renamed, in which case adding the watch or scanning it 
+    fails; this is logged rather than stopping the watch.
+*/
+void DirectoryWatcher::_add_directory(const bfs::path& path) {
+    try {
+        _add_watch(path);
+        for(bfs::recursive_directory_iterator it(path), end; it != end; it++)
+            if (bfs::is_regular_file(it->path()))
+                _add_file(it->path());
+    } catch(std::exception& e) {
+        std::ostringstream msg;
+        msg << "Couldn't watch " << path << ": " << e.what();
+        logger->message(msg.str(), warningLevel);
+    }
+}
+
+/*  Pass a file to the crawler. A file found by scanning a new directory 
+    may still be open for writing, and any file may be corrupt, so a 
+    failure is logged rather than stopping the watch. The crawler only 
+    marks files as seen once they have been analysed, so a file which 
+    failed because it was incomplete is tried again when it is closed.
+*/
+void DirectoryWatcher::_add_file(const bfs::path& path) {
+    try {
+        crawler.add_file(path);
+    } catch(std::exception& e) {
+        std::ostringstream msg;
+        msg << "Couldn't analyse " << path << ": " << e.what();
+        logger->message(msg.str(), warningLevel);
+    }
+}
+
+#else
+
+// inotify isn't available, so watching always fails
+DirectoryWatcher::DirectoryWatcher(Crawler& c, bool r): 
+    crawler(c), recursive(r), inotifyFd(-1), 
+    logger(new Logger(localLoggingLevel))
+{
+    throw WatchError("watch mode needs inotify (Linux only)", 0);
+}
+DirectoryWatcher::~DirectoryWatcher() { /* pass */ }
+void DirectoryWatcher::add(const bfs::path&) { /* pass */ }
+void DirectoryWatcher::run() { /* pass */ }
+
+#endif
@@ -0,0 +1,65 @@
+/*
+    watcher.hpp (ImageAnalyst)
+    Jess Robertson, 2026-10-18
+    
+    Watches directories for newly completed image files and passes them 
+    to a Crawler as they arrive. Uses inotify, so is only available on 
+    Linux.
+*/
+
+#ifndef WATCHER_HPP_6MZ1T4RE
+#define WATCHER_HPP_6MZ1T4RE
+
+#include "common.hpp"
+#include "logger.hpp"
+#include "crawler.hpp"
+#include <map>
+
+// = Class interface =
+class DirectoryWatcher {
+public:
+    DirectoryWatcher(Crawler& crawler, bool recursive);
+    virtual ~DirectoryWatcher();
+    
+    // Start watching a directory - call before the initial crawl so that 
+    // no files written during the crawl are missed
+    void add(const bfs::path& directory);
+    
+    // Process new files as they arrive, until interrupted (SIGINT/SIGTERM)
+    void run();
+    
+private:
+    Crawler& crawler;
+    const bool recursive;
+    int inotifyFd;
+    
+    // Watched directories
+    std::map<int, bfs::path> directories;
+    
+    // Private methods
+    void _add_watch(const bfs::path& directory);
+    void _handle_events(const char* buffer, std::size_t length);
+    void _add_directory(const bfs::path& path);
+    void _add_file(const bfs::path& path);
+    
+    // Logging
+	const static LogLevel localLoggingLevel = traceLevel;   
+	std::auto_ptr<Logger> logger;   
+};
+
+// = Exceptions =
+class WatchError: public std::exception {
+public:
+    WatchError(const std::string& what, int error) { 
+        std::ostringstream msg;
+        msg << "Unable to watch directories: " << what;
+        if (error != 0) msg << " (" << strerror(error) << ")";
+        _msg = msg.str();
+    } 
+    virtual ~WatchError() throw() { /* pass */ }
+    virtual const char* what() const throw() { return _msg.c_str(); }
+private:
+    std::string _msg;
+};
+
+#endif /* end of include guard: WATCHER_HPP_6MZ1T4RE */